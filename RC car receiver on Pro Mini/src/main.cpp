@@ -2,17 +2,14 @@
     The vehicle will be controlled by a remote control that will send data to this microcontroller.
     This program is designed to run on a Arduino Pro Mini.
     Date: 24-1-2022
-
-
-    To-Do:
-    - Validation for booleans
-    - Battery voltage reading
-    - Battery voltage sending to remote
 */
 
 #include <Arduino.h>
+#include <stddef.h> // offsetof()
 #include <LibPrintf.h>
 #include <Servo.h>
+#include <EEPROM.h>
+#include <hal.h> // Reset cause, watchdog and ADC of the Pro Mini, or of the Linux backend
 
 // NRF24L01 related
 #include <SPI.h>
@@ -44,9 +41,16 @@ const byte tailLight = A2;
 // Horn
 const byte horn = 9;
 
+// Binding
+const byte bindJumper = 2; // Connect to ground while powering up to bind the vehicle to a remote
+
 // Battery voltage monitoring
 const byte batteryValue = A3;
 
+// Extra servo outputs of the mixer
+const byte aux1Pin = 10;
+const byte aux2Pin = A0;
+
 // Data types
 struct dataPackage // Max size of this struct is 32 bytes, that's NRF24L01 buffer limit
 {
@@ -67,17 +71,112 @@ struct dataPackage // Max size of this struct is 32 bytes, that's NRF24L01 buffe
   bool honk = false;                // 0 = off, 1 = on
   bool headLight = false;           // 0 = off, 1 = on
   bool tailLight = false;           // 0 = off, 1 = on
+  uint8_t configIndex = 0;          // Index of the vehicleConfig byte carried by this package
+  uint8_t configValue = 0;          // Value of the vehicleConfig byte carried by this package
+  uint8_t hopIndex = 0xFF;          // 0...15, slot of the hop sequence this package is sent on, 0xFF = not hopping
+  uint16_t hopMask = 0;             // Slots of the hop sequence that are skipped because of interference
+  uint8_t sequence = 0;             // Counts up every package, used to count lost packages
+  uint8_t retryAverage = 0;         // Average retransmits per package of the remote times 16, used to adjust the power of the acknowledgements
+  uint8_t copies = 0;               // 0 = ARQ link, 1...4 = race link with this many copies of every package
+  uint8_t copy = 0;                 // 0...copies - 1, number of this copy in the race link
+} __attribute__((packed));
+
+struct telemetryPackage // Status of the vehicle, sent back with the acknowledgement of a package. Must be consistent with the sender
+{
+  uint8_t lostFrames = 0;      // 0...100 %, share of the packages of the remote that didn't arrive
+  uint8_t paLevel = 0;         // Power level of the vehicle, RF24_PA_MIN...RF24_PA_MAX
+  uint8_t firstCopy = 0;       // Average number of the first copy that arrived in the race link times 16
+  uint8_t watchdogResets = 0;  // Resets of the vehicle by the watchdog, stored in the EEPROM
+  uint8_t brownoutResets = 0;  // Resets of the vehicle by a low supply voltage, stored in the EEPROM
+  uint8_t externalResets = 0;  // Resets of the vehicle by the reset pin, stored in the EEPROM
+  uint16_t batteryVoltage = 0; // mV, filtered voltage of the battery of the vehicle
+  uint8_t batteryState = 0;    // 0 = ok, 1 = cutback, throttle is halved, 2 = cutoff, motor is stopped
+} __attribute__((packed));          // Packed, so the layout is the same on the Teensy LC and the Pro Mini
+
+struct vehicleConfig // Settings of the vehicle, streamed by the remote one byte per package. Must be consistent with the sender
+{
+  int8_t throttleTrim = 0;       // -30...30 degrees
+  int8_t steerTrim = 0;          // -30...30 degrees
+  uint8_t throttleExpo = 0;      // 0...100 %
+  uint8_t steerExpo = 0;         // 0...100 %
+  uint8_t failsafeThrottle = 90; // 0...180 degrees, throttle position when the connection is lost
+  uint8_t failsafeSteer = 90;    // 0...180 degrees, steering position when the connection is lost
+  uint8_t holdTime = 10;         // x10 ms without packages the last command is held
+  uint8_t cutTime = 25;          // x10 ms without packages after which the throttle has ramped to the failsafe position
+  uint8_t lostTime = 100;        // x10 ms without packages after which the vehicle counts as not connected
+  uint8_t batteryType = 0;       // 0 = not monitored, 1 = LiPo, 2 = LiFe, 3 = NiMH
+  uint8_t batteryCells = 2;      // 1...8 cells in series
+  uint8_t steerAtSpeed = 100;    // 30...100 %, steering range left at full throttle
+  uint8_t speedExpo = 0;         // 0...100 %, steering expo added at full throttle
+  uint8_t accelRate = 0;         // us per ms the throttle may move away from neutral, 0 = not limited. Halved in easy mode
+  uint8_t decelRate = 0;         // us per ms the throttle may move towards neutral, 0 = not limited. Halved in easy mode
+  uint8_t softStart = 100;       // x10 ms to open up the throttle after a failsafe or a reconnect, 0 = off
+  uint8_t launchTime = 0;        // x10 ms of the launch ramp when driving off from a standstill, 0 = off
+  uint8_t escType = 0;           // 0 = car ESC (brake, then reverse after neutral), 1 = crawler ESC (direct reverse), 2 = no reverse
+  uint8_t absRate = 0;           // 0...20 Hz, the brake is released half of every period, 0 = off
+};
+
+struct mixLine // One line of the channel mixer: output += weight * curve(input) + offset. Must be consistent with the sender
+{
+  uint8_t source; // Mixer input, 0xFF = unused line
+  uint8_t output; // Mixer output
+  int8_t weight;  // -100...100 %
+  int8_t offset;  // -100...100 % of the full travel
+  uint8_t curve;  // 0 = linear, 1 = positive side only, 2 = negative side only, 3 = absolute value
 };
 
+struct bindPackage // Sent by the remote on the bind channel to pair the vehicle with a model profile. Must be consistent with the sender
+{
+  uint8_t magic[3] = {'B', 'N', 'D'}; // Tells a bind package apart from noise
+  uint8_t address[5];                 // New RF address of the vehicle, LSB first
+  uint8_t channel;                    // NRF24L01 channel the vehicle uses after binding
+  uint8_t hopBands;                   // Bands of the hop range the hop sequence may use, found by the channel survey of the remote
+};
+
+const byte flagCount = offsetof(dataPackage, tailLight) - offsetof(dataPackage, rightJoystickButton) + 1; // Buttons and switches in a dataPackage, one after the other
+static_assert(sizeof(bool) == 1 && flagCount == 10, "validateData() expects the bools of dataPackage in one row of bytes");
+
+const byte mixLines = 8;            // Lines of the mixer table
+const byte mixerConfigIndex = 64;   // configIndex of the first byte of the mixer table, the vehicleConfig bytes come before it
+const byte mixSteer = 0;            // Mixer inputs, all scaled to -512...511
+const byte mixThrottle = 1;
+const byte mixRightX = 2;
+const byte mixLeftX = 3;
+const byte mixRightY = 4;
+const byte mixLeftY = 5;
+const byte mixAux1 = 6;
+const byte mixAux2 = 7;
+const byte mixHeadLight = 8;
+const byte mixTailLight = 9;
+const byte mixHonk = 10;
+const byte mixBrake = 11;
+const byte mixBatteryLow = 12;
+const byte mixFull = 13;
+const byte mixInputs = 14;
+const byte outSteering = 0;         // Mixer outputs
+const byte outMotor = 1;
+const byte outAux1 = 2;
+const byte outAux2 = 3;
+const byte outHeadLight = 4;
+const byte outTailLight = 5;
+const byte outHorn = 6;
+const byte mixOutputs = 7;
+
 // Objects
 RF24 radio(7, 8);      // CE, CSN
+const byte radioCE = 7; // CE pin of the radio, toggled directly for fast channel hops
 Servo motorcontroller; // Controls the speed of the vehicle
 Servo servo;           // Controls the steering of the vehicle
+Servo auxServo1;       // Extra output of the mixer, for example the rear steering or the second motor controller of a tank
+Servo auxServo2;       // Extra output of the mixer
 
 // Prototypes
 void debugReceivedSerial();
 void debugStatusSerial();
 void waitForRemote();
+void bindMode();
+bool loadBinding();
+void applyBinding();
 void idleMode();
 void easyMode();
 void proMode();
@@ -87,6 +186,51 @@ void updateAccessoires();
 void receiveData();
 void updatePwmDevices();
 void isConnected();
+void loadConfig();
+void updateConfig(byte index, byte value);
+int applyExpo(int value, byte expo);
+int applyFailsafe(int throttle);
+void buildHopTable(const uint8_t *hopAddress, byte baseChannel, byte bands, byte *table);
+byte hopBand(byte channel);
+byte nextHopSlot(byte slot, uint16_t mask);
+void syncHops(byte index, uint16_t mask);
+void followHops();
+void countHop(byte *counter, byte slot);
+void setChannelFast(byte channel);
+void updateLinkStats(byte sequence);
+void adaptPower(byte retryAverage);
+void followLink(byte copies, byte copy);
+void searchLink();
+void setLink(bool race);
+void countResets();
+void superviseTasks();
+void startBatteryMonitor();
+void monitorBattery();
+void updateBatteryState();
+int limitThrottle(int throttle);
+void calibrateBattery(unsigned long millivolts);
+void readSerial();
+void buildSteerSchedule();
+byte scheduled(const byte *table, unsigned int throttle);
+int throttleMicros(int degrees);
+void setThrottle(int degrees);
+void shapeThrottle();
+byte brakeStrength();
+int arbitrateBrake(int throttle, int neutral, int fullReverse);
+void loadMixer();
+void updateMixer(byte index, byte value);
+void compileMixer();
+void runMixer();
+int toMix(int degrees);
+int fromMix(int value);
+void startBlackBox();
+void recordBlackBox();
+void triggerBlackBox(byte event);
+void writeBlackBox();
+void dumpBlackBox();
+void printBlackBox();
+void clearBlackBox();
+uint16_t blackBoxChecksum();
 
 // Global variables
 const byte idle = 0;  // Statemachine options
@@ -94,18 +238,93 @@ const byte easy = 1;  // Statemachine options
 const byte pro = 2;   // Statemachine options
 const byte debug = 3; // Statemachine options
 const byte notConnected = 4;
-const uint64_t address[2] = {0xA40F7CA5F7LL, 0x32FA46D0E2LL}; // First address for communication from the vehicle, second address for communication to the vehicle. Second address unused for now.
+const byte binding = 5;
+const uint64_t address[2] = {0xA40F7CA5F7LL, 0x32FA46D0E2LL}; // First address is used on the bind channel to pair the vehicle with a remote, second address unused for now.
+const byte bindChannel = 80;                                  // Well-known channel for binding, the remote hands out the address and channel for driving
+const byte framePeriod = 10;                                  // ms between packages of the remote while hopping. Must be consistent with the sender
+const unsigned int hopLateness = 7500;                        // us a package may come after its frame: a display page of the remote (3.2 ms) and a write through all retransmits of the hopping (4 x 1 ms). Must be consistent with the sender
+const byte hopCount = 16;                                     // Number of channels in the hop sequence
+const byte hopLowest = 2;                                     // Lowest channel the hop sequence uses
+const byte hopHighest = 79;                                   // Highest channel the hop sequence uses, stays below the bind channel
+const byte noHopping = 0xFF;                                  // hopIndex of packages that are not hopping
+const byte hopBandCount = 8;                                  // The hop range is split in bands, the channel survey of the remote chooses which ones the sequence uses
 dataPackage rawData;                                          // Create a variable with the above structure
 dataPackage rxData;                                           // Create a variable with the above structure
+vehicleConfig config;                                         // Settings of the vehicle, received from the remote and kept in EEPROM
+bindPackage bound;                                            // Address and channel of the remote the vehicle is bound to
+byte hopTable[hopCount];                                      // Channels of the hop sequence, derived from the bound address
+byte hopIndex = noHopping;                                    // Slot of the hop sequence the radio listens on, noHopping when the remote stays on one channel
+uint16_t hopMask = 0;                                         // Slots the remote skips because of interference
+unsigned long hopDeadline = 0;                                // micros() after which the package of the current slot is considered lost
+byte missedHops = 0;                                          // Packages missed in a row, the vehicle starts searching for the remote after too many
+byte hopReceived[hopCount];                                   // Packages received per slot
+byte hopLost[hopCount];                                       // Packages lost per slot
+telemetryPackage telemetry;                                   // Status of the vehicle for the remote
+bool raceLink = false;                                        // Radio is set to the race link: 2 Mbps without acknowledgements
+mixLine mixTable[mixLines];                                   // Mixer table, received from the remote and kept in EEPROM
+int16_t mixIn[mixInputs];                                     // Inputs of the mixer, -512...511. The modes fill them before runMixer()
+bool invalidSeen = false;                                     // A package was rejected since the black box took its last sample
+
+// EEPROM layout
+const int eepromBinding = 0;     // bindPackage of the remote the vehicle is bound to
+const int eepromResets = 16;     // Watchdog, brownout and external reset counters
+const int eepromBatteryScale = 20; // Calibration of the battery voltage, mV at the full scale of the ADC
+const int eepromConfigSize = 32; // Size of vehicleConfig when it was stored, the defaults are used when the layout changes
+const int eepromConfig = 33;     // Settings of the vehicle received from the remote
+const int eepromMixerSize = 95;  // Size of the mixer table when it was stored, the default table is used when the layout changes
+const int eepromMixer = 96;      // Mixer table received from the remote
+const int eepromBlackBox = 136;  // Records of the black box, up to the end of the EEPROM
+static_assert(eepromConfig + sizeof(vehicleConfig) <= eepromMixerSize, "vehicleConfig runs into the mixer table in the EEPROM");
+static_assert(eepromMixer + sizeof(mixTable) <= eepromBlackBox, "The mixer table runs into the black box in the EEPROM");
+
+// Watchdog supervision
+const byte radioTask = 1;    // Bits of tasksDone, set by every task when it has run
+const byte outputTask = 2;
+const byte failsafeTask = 4;
+const byte allTasks = radioTask | outputTask | failsafeTask;
+byte tasksDone = 0;          // Tasks that have run since the watchdog was kicked last
+
+#ifdef __AVR__
+// Runs before the variables are initialized, so also before the Servo library and setup(). Keeps the servo and motor outputs low until
+// setup() starts the neutral pulses. That is no signal rather than neutral: the ESC doesn't drive, but an ESC without a signal may
+// beep or go into its own failsafe
+void holdOutputs() __attribute__((naked, used, section(".init3")));
+void holdOutputs()
+{
+  PORTD &= ~(_BV(PD3) | _BV(PD5)); // Motor controller (D3) and steering servo (D5)
+  DDRD |= _BV(PD3) | _BV(PD5);
+}
+#endif
 
 void setup()
 {
+  motorcontroller.write(90); // Neutral pulses right away, before the slower initialization of the radio
+  servo.write(90);
+  motorcontroller.attach(3);
+  servo.attach(5);
+  loadConfig(); // Settings of the last remote, until the remote sends them again
+  loadMixer();
+  countResets();
+  startBlackBox(); // After a watchdog or brownout reset it records the samples from before
+  startBatteryMonitor();
+
   radio.begin(); // Start NRF24L01
-  radio.openReadingPipe(0, address[0]);
   radio.setPALevel(RF24_PA_MIN);
-  radio.startListening();
+  radio.enableDynamicPayloads(); // Needed for the confirmation to the remote while binding
+  radio.enableAckPayload();
+  pinMode(bindJumper, INPUT_PULLUP);
+  if (loadBinding() && digitalRead(bindJumper) == HIGH) // Start listening to the bound remote right away, no searching at power-on
+    applyBinding();
+  else // Never bound or the user asks for a new binding
+  {
+    radio.openReadingPipe(1, address[0]);
+    radio.setChannel(bindChannel);
+    radio.startListening();
+    rxData.mode = binding;
+  }
 
   Serial.begin(9600); // For debugging purposes
+  printf("reset flags: %i, watchdog: %i, brownout: %i, external: %i\n", halResetFlags(), telemetry.watchdogResets, telemetry.brownoutResets, telemetry.externalResets);
 
   // Lights
   pinMode(receivedLED, OUTPUT);
@@ -113,9 +332,7 @@ void setup()
   pinMode(headLight, OUTPUT);
   pinMode(tailLight, OUTPUT);
 
-  // PWM devices
-  motorcontroller.attach(3);
-  servo.attach(5);
+  halWatchdogStart(); // The status dumps on the serial monitor take longer than this at 9600 baud, don't leave them on while driving
 }
 
 void loop()
@@ -125,6 +342,9 @@ void loop()
   case notConnected:
     waitForRemote();
     break;
+  case binding:
+    bindMode();
+    break;
   case idle:
     idleMode();
     break;
@@ -138,22 +358,130 @@ void loop()
     debugMode();
     break;
   }
+  shapeThrottle();
+  monitorBattery();
+  readSerial();
+  recordBlackBox();
+  superviseTasks();
+}
+
+// Kicks the watchdog only when the radio, output and failsafe tasks have all run since the last kick. When one of them hangs, also in SPI,
+// the watchdog resets the vehicle and the outputs stop
+void superviseTasks()
+{
+  if (tasksDone != allTasks)
+    return;
+  halWatchdogKick();
+  tasksDone = 0;
+}
+
+// Adds the cause of this startup to the reset counters in the EEPROM, they saturate at 255
+void countResets()
+{
+  EEPROM.get(eepromResets, telemetry.watchdogResets);
+  EEPROM.get(eepromResets + 1, telemetry.brownoutResets);
+  EEPROM.get(eepromResets + 2, telemetry.externalResets);
+  if (telemetry.watchdogResets == 0xFF && telemetry.brownoutResets == 0xFF && telemetry.externalResets == 0xFF) // Never counted before
+  {
+    telemetry.watchdogResets = 0;
+    telemetry.brownoutResets = 0;
+    telemetry.externalResets = 0;
+  }
+  byte resetFlags = halResetFlags();
+  if ((resetFlags & halResetPowerOn) == 0) // Power-on also sets the brownout flag, it isn't counted
+  {
+    if ((resetFlags & halResetWatchdog) && telemetry.watchdogResets < 255)
+      telemetry.watchdogResets++;
+    else if ((resetFlags & halResetBrownout) && telemetry.brownoutResets < 255)
+      telemetry.brownoutResets++;
+    else if ((resetFlags & halResetExternal) && telemetry.externalResets < 255)
+      telemetry.externalResets++;
+  }
+  EEPROM.update(eepromResets, telemetry.watchdogResets);
+  EEPROM.update(eepromResets + 1, telemetry.brownoutResets);
+  EEPROM.update(eepromResets + 2, telemetry.externalResets);
 }
 
 unsigned long headLightBlink = 0; // Makes the headlight and tail light blink when in idle mode
+bool blinkOn = false;             // The headlight and tail light are on in this blink period
 // Function that is called when the vehicle is not connected to the remote
 void waitForRemote()
 {
-  motorcontroller.write(90);
-  servo.write(90);
+  if (millis() - headLightBlink > 1500) // Show that the vehicle is in idle mode by blinking the headlight and tail light
+  {
+    headLightBlink = millis();
+    blinkOn = !blinkOn;
+  }
+  memset(mixIn, 0, sizeof(mixIn)); // Sticks centered and buttons released
+  mixIn[mixHeadLight] = blinkOn ? 511 : 0;
+  mixIn[mixTailLight] = blinkOn ? 511 : 0;
+  mixIn[mixSteer] = toMix(constrain(config.failsafeSteer, 0, 180)); // Failsafe positions of the active model profile, every output of the mixer follows them
+  mixIn[mixThrottle] = toMix(constrain(config.failsafeThrottle, 0, 180));
+  runMixer();
+  tasksDone |= outputTask | failsafeTask; // Not connected is the last stage of the failsafe
   receiveData();
   // debugStatusSerial();                  // DEBUG
-  if (millis() - headLightBlink > 1500) // Show that the vehicle is in idle mode by blinking the headlight and tail light
+}
+
+bindPackage bindRequest;   // Last bind request that was confirmed to a remote
+bool bindConfirmed = false; // The confirmation for bindRequest is waiting in the ack payload
+// Function that is called when the vehicle waits for a remote to bind to. Finishes when the remote sends its request again, which carries the confirmation back
+void bindMode()
+{
+  setThrottle(90);
+  servo.write(90);
+  tasksDone |= radioTask | outputTask | failsafeTask; // Outputs are neutral while binding, the radio is read below
+  if (millis() - headLightBlink > 250) // Show that the vehicle is binding by blinking the headlight and tail light fast
   {
     headLightBlink = millis();
     digitalWrite(headLight, !digitalRead(headLight));
     digitalWrite(tailLight, !digitalRead(tailLight));
   }
+
+  if (radio.available())
+  {
+    bindPackage request;
+    radio.read(&request, sizeof(bindPackage));
+    if (memcmp(request.magic, bound.magic, sizeof(request.magic)) != 0 || request.channel > 125) // Not a bind request
+      return;
+    if (bindConfirmed && memcmp(&request, &bindRequest, sizeof(bindPackage)) == 0) // Remote received the confirmation with this ack
+    {
+      bound = request;
+      EEPROM.put(eepromBinding, bound);
+      applyBinding();
+      rxData.mode = notConnected;
+      tone(horn, 880, 200);
+    }
+    else // New request, answer with a copy of it on the next package
+    {
+      bindRequest = request;
+      radio.flush_tx();
+      bindConfirmed = radio.writeAckPayload(1, &bindRequest, sizeof(bindPackage));
+    }
+  }
+}
+
+// Reads the remote the vehicle is bound to from the EEPROM. Returns false when the vehicle was never bound
+bool loadBinding()
+{
+  bindPackage stored;
+  EEPROM.get(eepromBinding, stored);
+  if (memcmp(stored.magic, bound.magic, sizeof(stored.magic)) != 0 || stored.channel > 125)
+    return false;
+  bound = stored;
+  return true;
+}
+
+// Starts listening to the remote the vehicle is bound to
+void applyBinding()
+{
+  radio.stopListening();
+  radio.flush_tx(); // Don't send a leftover bind confirmation on the new address
+  radio.openReadingPipe(1, bound.address);
+  radio.setChannel(bound.channel);
+  radio.startListening();
+  buildHopTable(bound.address, bound.channel, bound.hopBands, hopTable);
+  hopIndex = noHopping; // Wait on the channel of the binding until the remote shows whether it hops
 }
 
 // Function that is called when the vehicle is in idle mode
@@ -163,7 +491,10 @@ void idleMode()
   isConnected();
   // debugStatusSerial(); // DEBUG
   updateAccessoires();
-  motorcontroller.write(90); // Stop the motor
+  mixIn[mixSteer] = toMix(90 + constrain(config.steerTrim, -30, 30)); // Center the steering and stop the motor
+  mixIn[mixThrottle] = toMix(90 + constrain(config.throttleTrim, -30, 30));
+  runMixer();
+  tasksDone |= outputTask;
 }
 
 // Function that is called when the vehicle is in easy mode
@@ -190,49 +521,77 @@ void debugMode()
 {
   receiveData();
   isConnected();
+  tasksDone |= outputTask; // Outputs keep their last position in debug mode
 }
 
-unsigned long lastReceive = 0; // The time the last data was received
-// Function that checks if the vehicle is still connected to the remote
+unsigned long lastReceive = 0; // micros() of the last valid package
+// Function that checks if the vehicle is still connected to the remote, the last stage of the failsafe
 void isConnected()
 {
-  if (millis() - lastReceive > 3000)
+  if (micros() - lastReceive > constrain(config.lostTime, 10, 250) * 10000UL)
   {
     rxData.mode = notConnected;
   }
+  tasksDone |= failsafeTask;
+}
+
+// First stages of the failsafe: the last throttle is held during a short dropout, then it ramps to the failsafe position
+int applyFailsafe(int throttle)
+{
+  unsigned long silence = micros() - lastReceive;
+  unsigned long hold = config.holdTime * 10000UL;
+  unsigned long cut = config.cutTime * 10000UL;
+  if (silence <= hold)
+    return throttle;
+  if (silence >= cut || cut <= hold)
+    return config.failsafeThrottle;
+  return throttle + (long)(config.failsafeThrottle - throttle) * (long)(silence - hold) / (long)(cut - hold);
 }
 
 // Check if data is received, if so read the data and validate
 void receiveData()
 {
+  followHops();          // Keep hopping along with the remote, also when packages are missed
+  searchLink();          // Try the other link when the remote stays silent
   if (radio.available()) // Data received
   {
     digitalWrite(receivedLED, HIGH);           // Turn on the received LED
-    lastReceive = millis();                    // Make a timestamp for the last time data was received
+    byte length = radio.getDynamicPayloadSize(); // A package of another length isn't from the remote, part of rawData would be stale
     radio.read(&rawData, sizeof(dataPackage)); // Read data
     // debugReceivedSerial();                     // For debugging purposes
-    if (validateData(rawData)) // Check if data is valid
+    // Later copies of a package of the race link that already arrived are dropped
+    bool duplicate = rawData.copies > 0 && rawData.sequence == rxData.sequence && rxData.mode != notConnected;
+    if (duplicate == false && length == sizeof(dataPackage) && validateData(rawData)) // Check if data is valid
     {
       if (rxData.mode == notConnected) // Play a sound when remote vehicle picks up communication with remote
+        tone(horn, 880, 500);          // Doesn't block, so the failsafe and the watchdog keep running
+      lastReceive = micros();                               // Make a timestamp for the last time valid data was received, the failsafe runs from here
+      rxData = rawData;                                     // Transfer received data to rxData
+      updateConfig(rxData.configIndex, rxData.configValue); // Every package carries one byte of the vehicle settings
+      syncHops(rxData.hopIndex, rxData.hopMask);            // Listen on the channel of the next package
+      updateLinkStats(rxData.sequence);
+      followLink(rxData.copies, rxData.copy);
+      if (raceLink == false) // The status goes back with the acknowledgements, the race link has none
       {
-        tone(horn, 220, 500);
-        delay(500);
-        tone(horn, 880, 500);
-        delay(1000);
+        adaptPower(rxData.retryAverage);
+        radio.flush_tx(); // Replace the status that wasn't picked up by the remote
+        radio.writeAckPayload(1, &telemetry, sizeof(telemetryPackage));
       }
-      rxData = rawData; // Transfer received data to rxData
     }
-    else
+    else if (duplicate == false)
+    {
       digitalWrite(interferenceLED, HIGH); // Data is invalid, turn on the interference LED
+      invalidSeen = true;
+    }
     digitalWrite(receivedLED, LOW);        // Turn off the received LED
   }
+  tasksDone |= radioTask;
 }
 
 // Checks if the data received from the remote is valid
 bool validateData(dataPackage check)
 {
   // Check if all values are within the valid range, if not return false
-  // Haven't found a good way to check for booleans
   if (check.rightX > 1023 || check.rightX < -1)
   {
     printf("case1\n");
@@ -268,31 +627,71 @@ bool validateData(dataPackage check)
     printf("case7\n");
     return false;
   }
+  if (check.configIndex >= sizeof(vehicleConfig) && (check.configIndex < mixerConfigIndex || check.configIndex >= mixerConfigIndex + sizeof(mixTable)))
+  {
+    printf("case8\n");
+    return false;
+  }
+  if (check.hopIndex >= hopCount && check.hopIndex != noHopping)
+  {
+    printf("case9\n");
+    return false;
+  }
+  if (check.copies > 4 || (check.copies > 0 && check.copy >= check.copies))
+  {
+    printf("case10\n");
+    return false;
+  }
+  const byte *flags = (const byte *)&check.rightJoystickButton; // Checked as bytes, a bool holding anything but 0 or 1 is undefined behaviour
+  for (byte i = 0; i < flagCount; i++)
+  {
+    if (flags[i] > 1)
+    {
+      printf("case11\n");
+      return false;
+    }
+  }
   return true;
 }
 
-// Update hardware features based on the data received from the remote. For example head lights, tail lights, horn, etc.
+// Update the mixer inputs of the hardware features based on the data received from the remote. For example head lights, tail lights, horn, etc.
 void updateAccessoires()
 {
-  if (rxData.headLight)
-    digitalWrite(headLight, HIGH);
-  else
-    digitalWrite(headLight, LOW);
-
-  if (rxData.tailLight)
-    digitalWrite(tailLight, HIGH);
-  else
-    digitalWrite(tailLight, LOW);
+  mixIn[mixAux1] = rxData.auxButton1 ? 511 : 0;
+  mixIn[mixAux2] = rxData.auxButton2 ? 511 : 0;
+  mixIn[mixHeadLight] = rxData.headLight ? 511 : 0;
+  mixIn[mixTailLight] = rxData.tailLight ? 511 : 0;
+  mixIn[mixHonk] = rxData.honk ? 511 : 0;
+  mixIn[mixBrake] = rxData.brake ? 511 : 0;
+  mixIn[mixBatteryLow] = telemetry.batteryState > 0 ? 511 : 0;
+  mixIn[mixRightX] = rxData.rightX < 0 ? 0 : rxData.rightX - 512; // Sticks centered, 0 while uninitialized
+  mixIn[mixLeftX] = rxData.leftX < 0 ? 0 : rxData.leftX - 512;
+  mixIn[mixRightY] = rxData.rightY < 0 ? 0 : rxData.rightY - 512;
+  mixIn[mixLeftY] = rxData.leftY < 0 ? 0 : rxData.leftY - 512;
+}
 
-  if (rxData.honk)
+const byte scheduleSteps = 8;              // Steps of the steering schedule, 64 wide on the commanded throttle
+byte steerGain[scheduleSteps + 1];         // 0...100 %, steering range per step of the commanded throttle
+byte steerExpoSchedule[scheduleSteps + 1]; // 0...100 %, steering expo per step of the commanded throttle
+// Precomputes the steering schedule from the settings of the vehicle. The change grows with the square of the throttle, so low speeds keep the full steering
+void buildSteerSchedule()
+{
+  byte atSpeed = constrain(config.steerAtSpeed, 30, 100);
+  for (byte step = 0; step <= scheduleSteps; step++)
   {
-    tone(horn, 220, 500);
+    unsigned int weight = step * step; // 0...64
+    steerGain[step] = 100 - (100 - atSpeed) * weight / 64;
+    steerExpoSchedule[step] = min(config.steerExpo + config.speedExpo * weight / 64, 100u);
   }
+}
 
-  if (rxData.brake)
-  {
-    motorcontroller.write(0);
-  }
+// Looks up a value of a steering schedule, linear between the two steps around the commanded throttle
+byte scheduled(const byte *table, unsigned int throttle)
+{
+  byte step = throttle >> 6;
+  if (step >= scheduleSteps)
+    return table[scheduleSteps];
+  return table[step] + (((int)table[step + 1] - table[step]) * (int)(throttle & 63) >> 6);
 }
 
 // Update the servo and motorcontroller with the most recent data
@@ -302,19 +701,258 @@ void updatePwmDevices()
   const byte middlepoint = upperBoundary / 2;
 
   // printf("\n\n\n"); // DEBUG
-  unsigned int max = middlepoint + (float)middlepoint / 100 * rxData.steerSensitifity; // Calculate the maximum value of steering
-  unsigned int min = middlepoint - (float)middlepoint / 100 * rxData.steerSensitifity; // Calculate the minimum value of steering
-  unsigned int steerPosition = map(rxData.leftX, 0, 1023, min, max);                   // Calculate the position of the servo
-  servo.write(steerPosition);                                                          // Update the servo
+  unsigned int speed = abs(rxData.rightY - 512);                                                 // Commanded throttle, 0...512 in both directions
+  byte sensitivity = constrain(rxData.steerSensitifity, 0, 100);                                // -1 = uninitialized steers like 0, straight ahead
+  unsigned int range = (unsigned long)middlepoint * sensitivity * scheduled(steerGain, speed) / 10000; // Less steering range at speed
+  unsigned int max = middlepoint + range;                                                        // Calculate the maximum value of steering
+  unsigned int min = middlepoint - range;                                                        // Calculate the minimum value of steering
+  int steerInput = applyExpo(rxData.leftX, scheduled(steerExpoSchedule, speed));                 // Apply the steering curve of the model profile, softer at speed
+  int steerPosition = map(steerInput, 0, 1023, min, max) + constrain(config.steerTrim, -30, 30); // Calculate the position of the servo
+  mixIn[mixSteer] = toMix(constrain(steerPosition, 0, 180));                                     // Steering input of the mixer
   // printf("Steer max: %i, min: %i, pos: %i\n", max, min, steerPosition); // DEBUG
 
   max = middlepoint + (float)middlepoint / 100 * rxData.throttleSensitifity; // Calculate the maximum value of throttle
   min = middlepoint - (float)middlepoint / 100 * rxData.throttleSensitifity; // Calculate the minimum value of throttle
-  unsigned int throttle = map(rxData.rightY, 0, 1023, min, max);             // Calculate the value of the throttle
-  motorcontroller.write(throttle);                                           // Update the motor controller
+  int throttleInput = applyExpo(rxData.rightY, config.throttleExpo);                            // Apply the throttle curve of the model profile
+  int throttle = map(throttleInput, 0, 1023, min, max) + constrain(config.throttleTrim, -30, 30); // Calculate the value of the throttle
+  throttle = limitThrottle(throttle);                                                            // Protect the battery of the vehicle
+  throttle = arbitrateBrake(throttle, middlepoint + constrain(config.throttleTrim, -30, 30), min + constrain(config.throttleTrim, -30, 30)); // The brake overrules the throttle
+  throttle = applyFailsafe(throttle);                                                            // Ramp to the failsafe position when the remote is silent
+  mixIn[mixThrottle] = toMix(constrain(throttle, 0, 180));                                       // Throttle input of the mixer
+  runMixer();                                                                                    // Update the servos and the motor controller
+  tasksDone |= outputTask;
   // printf("Throttle max: %i, min: %i, pos: %i\n", max, min, throttle); // DEBUG
 }
 
+// Bends a joystick value (0...1023) around the center, expo 0 = linear, 100 = cubic. Gives finer control around the center
+int applyExpo(int value, byte expo)
+{
+  if (expo == 0 || value < 0) // Linear or uninitialized
+    return value;
+  if (expo > 100)
+    expo = 100;
+  long x = value - 512;               // -512...511
+  long cubic = x * x / 512 * x / 512; // Same range as x
+  return 512 + (x * (100 - expo) + cubic * expo) / 100;
+}
+
+// Reads the vehicle settings from the EEPROM, the defaults are used when the EEPROM holds none or an older layout
+void loadConfig()
+{
+  if (EEPROM.read(eepromConfigSize) == sizeof(vehicleConfig))
+    EEPROM.get(eepromConfig, config);
+  buildSteerSchedule();
+}
+
+// Stores one byte of the vehicle settings sent by the remote. Only changed bytes are written to the EEPROM
+void updateConfig(byte index, byte value)
+{
+  byte *bytes = (byte *)&config;
+  if (index >= mixerConfigIndex)
+  {
+    updateMixer(index - mixerConfigIndex, value);
+    return;
+  }
+  if (index >= sizeof(vehicleConfig) || bytes[index] == value)
+    return;
+  bytes[index] = value;
+  buildSteerSchedule();
+  if (EEPROM.read(eepromConfigSize) == sizeof(vehicleConfig))
+    EEPROM.update(eepromConfig + index, value);
+  else // First settings in this layout, store the defaults of the other bytes too
+  {
+    EEPROM.put(eepromConfig, config);
+    EEPROM.update(eepromConfigSize, sizeof(vehicleConfig));
+  }
+}
+
+// Returns the band of the hop range a channel belongs to, hopBandCount for channels outside of the hop range. Must be consistent with the sender
+byte hopBand(byte channel)
+{
+  if (channel < hopLowest || channel > hopHighest)
+    return hopBandCount;
+  return (channel - hopLowest) * hopBandCount / (hopHighest - hopLowest + 1);
+}
+
+// Derives the hop sequence from the bound address. Slot 0 is the channel of the binding, so the vehicle can find the remote there. Must be consistent with the sender
+void buildHopTable(const uint8_t *hopAddress, byte baseChannel, byte bands, byte *table)
+{
+  uint32_t seed = 0;
+  for (byte i = 0; i < 5; i++)
+    seed = seed * 31 + hopAddress[i];
+  seed |= 1; // Xorshift never leaves zero
+  byte allowed = 0;
+  for (byte i = 0; i < hopBandCount; i++)
+    allowed += (bands >> i) & 1;
+  if (allowed < 2) // Too few channels for a sequence, use the whole hop range
+    bands = 0xFF;
+
+  table[0] = baseChannel;
+  for (byte slot = 1; slot < hopCount; slot++)
+  {
+    bool used;
+    do // Draw channels until one is found that isn't in the sequence yet
+    {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      table[slot] = hopLowest + seed % (hopHighest - hopLowest + 1);
+      used = (bands & (1 << hopBand(table[slot]))) == 0; // Band is too busy
+      for (byte i = 0; i < slot; i++)
+        used |= table[i] == table[slot];
+    } while (used);
+  }
+}
+
+// Returns the slot after the given one that isn't skipped. Must be consistent with the sender
+byte nextHopSlot(byte slot, uint16_t mask)
+{
+  for (byte i = 0; i < hopCount; i++)
+  {
+    slot = (slot + 1) % hopCount;
+    if ((mask & ((uint16_t)1 << slot)) == 0)
+      return slot;
+  }
+  return 0;
+}
+
+// Adds one to a loss counter of a slot. Both counters of the slot are halved when it overflows, so the ratio stays intact
+void countHop(byte *counter, byte slot)
+{
+  if (++counter[slot] == 255)
+  {
+    hopReceived[slot] /= 2;
+    hopLost[slot] /= 2;
+  }
+}
+
+// Follows the hop sequence of the remote with the package that was just received
+void syncHops(byte index, uint16_t mask)
+{
+  if (index == noHopping) // Remote stays on the channel of the binding
+  {
+    if (hopIndex != noHopping)
+      setChannelFast(bound.channel);
+    hopIndex = noHopping;
+    return;
+  }
+  countHop(hopReceived, index);
+  hopMask = mask & ~1; // Slot 0 is never skipped, the vehicle searches there
+  hopIndex = nextHopSlot(index, hopMask);
+  setChannelFast(hopTable[hopIndex]);
+  unsigned long frameStart = micros();
+  if (rxData.copies > 0) // Copies of the race link are spread over the frame
+    frameStart -= rxData.copy * (framePeriod * 1000UL / rxData.copies);
+  hopDeadline = frameStart + framePeriod * 1000UL + hopLateness; // The next package may come as late as the worst-case write of the remote
+  missedHops = 0;
+}
+
+// Hops on when the package of the current slot doesn't arrive in time. After too many misses the vehicle waits on slot 0, the remote comes by there once per sequence
+void followHops()
+{
+  if (hopIndex == noHopping || missedHops > 2 * hopCount || (long)(micros() - hopDeadline) < 0)
+    return;
+  countHop(hopLost, hopIndex);
+  missedHops++;
+  if (missedHops > 2 * hopCount) // Lost track of the remote, search for it
+    hopIndex = 0;
+  else
+    hopIndex = nextHopSlot(hopIndex, hopMask);
+  setChannelFast(hopTable[hopIndex]);
+  hopDeadline += framePeriod * 1000UL;
+}
+
+// Changes the channel while listening. Faster than stopListening() and startListening(), and keeps the ack payloads
+void setChannelFast(byte channel)
+{
+  digitalWrite(radioCE, LOW);
+  radio.setChannel(channel);
+  digitalWrite(radioCE, HIGH);
+}
+
+byte lastSequence = 0;        // Sequence number of the last package
+byte framesReceived = 0;      // Packages received since the last update of the loss statistics
+byte framesLost = 0;          // Packages lost since the last update of the loss statistics
+// Counts the packages that went missing between two received packages, the remote numbers all its packages
+void updateLinkStats(byte sequence)
+{
+  byte gap = sequence - lastSequence - 1;
+  lastSequence = sequence;
+  if (gap < 100) // Larger gaps are a new connection, not a lost stretch
+    framesLost = min(framesLost + gap, 255);
+  if (++framesReceived < 64) // Update the statistics every 64 packages
+    return;
+  telemetry.lostFrames = (unsigned int)framesLost * 100 / (framesReceived + framesLost);
+  framesReceived = 0;
+  framesLost = 0;
+}
+
+byte calmWindows = 0; // Evaluations in a row with a clean link, the power only goes down after a few
+// Steps the power of the acknowledgements up when the remote needs retransmits, and slowly down again when the link is clean. Works the same as the power control of the remote
+void adaptPower(byte retryAverage)
+{
+  if (framesReceived % 32 != 0) // Evaluate every 32 packages
+    return;
+
+  if ((retryAverage > 32 || telemetry.lostFrames > 10) && telemetry.paLevel < RF24_PA_MAX) // More than two retransmits per package or 10 % lost
+  {
+    telemetry.paLevel++;
+    calmWindows = 0;
+    radio.setPALevel(telemetry.paLevel);
+  }
+  else if (retryAverage < 4 && telemetry.lostFrames < 2 && telemetry.paLevel > RF24_PA_MIN) // Almost no retransmits, wait a few evaluations before stepping down
+  {
+    if (++calmWindows >= 8)
+    {
+      telemetry.paLevel--;
+      calmWindows = 0;
+      radio.setPALevel(telemetry.paLevel);
+    }
+  }
+  else
+    calmWindows = 0;
+}
+
+// Switches to the link the remote asks for in its packages. The remote waits for the acknowledgement of the request before it switches itself
+void followLink(byte copies, byte copy)
+{
+  if (copies > 0) // Shows the remote how long the copies take to get through
+    telemetry.firstCopy = telemetry.firstCopy - telemetry.firstCopy / 8 + copy * 2;
+  if ((copies > 0) != raceLink)
+    setLink(copies > 0);
+}
+
+unsigned long lastLinkSearch = 0; // Time of the last switch between the links while searching
+// Tries the other link every 250 ms when the remote stays silent, the vehicle may have missed the request to switch over.
+// In the idle and debug modes the remote sends every third of the lost time, the search waits until two of those packages are missing
+void searchLink()
+{
+  unsigned long silent = max(500000UL, constrain(config.lostTime, 10, 250) * 20000UL / 3);
+  if (micros() - lastReceive < silent || millis() - lastLinkSearch < 250)
+    return;
+  lastLinkSearch = millis();
+  setLink(raceLink == false);
+}
+
+// Sets the radio to the ARQ link (1 Mbps with acknowledgements) or the race link (2 Mbps without acknowledgements). Must be consistent with the sender
+void setLink(bool race)
+{
+  raceLink = race;
+  digitalWrite(radioCE, LOW); // Keeps listening, like setChannelFast()
+  if (race)
+  {
+    radio.setAutoAck(false); // Also turns off the ack payloads
+    radio.setDataRate(RF24_2MBPS);
+  }
+  else
+  {
+    radio.setAutoAck(true);
+    radio.enableAckPayload();
+    radio.setDataRate(RF24_1MBPS);
+  }
+  digitalWrite(radioCE, HIGH);
+}
+
 unsigned long lastSerial = 0; // Keeps track of the last time serial data was sent
 // Prints all relevant data that has been received from the remote to the serial monitor. Used for debugging purposes
 void debugReceivedSerial()
@@ -370,5 +1008,693 @@ void debugStatusSerial()
     printf("tailLight: %i\n", rxData.tailLight);
     printf("throttleSensitifity: %i\n", rxData.throttleSensitifity);
     printf("steeringSensitifity: %i\n", rxData.steerSensitifity);
+    printf("paLevel: %i\n", telemetry.paLevel);
+    printf("lostFrames: %i%%\n", telemetry.lostFrames);
+    printf("retryAverage: %i\n", rxData.retryAverage);
+    printf("raceLink: %i, copies: %i\n", raceLink, rxData.copies);
+    printf("battery: %u mV, state %i\n", telemetry.batteryVoltage, telemetry.batteryState);
+    printf("resets: watchdog %i, brownout %i, external %i\n", telemetry.watchdogResets, telemetry.brownoutResets, telemetry.externalResets);
+    printf("hopIndex: %i\n", hopIndex);
+    for (byte i = 0; i < hopCount; i++) // Loss counters per channel of the hop sequence
+      printf("channel %i: %i received, %i lost\n", hopTable[i], hopReceived[i], hopLost[i]);
+  }
+}
+// Battery monitor
+struct batteryPreset // Voltages per cell of a battery chemistry
+{
+  uint16_t cutback; // mV, below this the throttle is halved
+  uint16_t cutoff;  // mV, below this the motor is stopped until the vehicle is restarted
+};
+const batteryPreset batteryPresets[] = {
+    {0, 0},       // Not monitored
+    {3500, 3300}, // LiPo
+    {3000, 2800}, // LiFe
+    {1050, 950},  // NiMH
+};
+const byte batteryOk = 0; // States of the battery, reported to the remote
+const byte batteryCutback = 1;
+const byte batteryCutoff = 2;
+const byte batteryOversampling = 64;     // Samples per measurement, the sum still fits in 16 bits
+unsigned int batteryScale = 13200;       // mV at the full scale of the ADC, the divider on A3 brings the battery down to 3.3 V
+unsigned int batterySum = 0;             // Sum of the samples of the current measurement
+byte batterySamples = 0;                 // Samples in batterySum
+long batteryFiltered = -1;               // Filtered voltage in mV x16, -1 until the first measurement
+
+// Starts the ADC on the battery input. Reads the calibration from the EEPROM
+void startBatteryMonitor()
+{
+  unsigned int stored;
+  EEPROM.get(eepromBatteryScale, stored);
+  if (stored != 0xFFFF && stored != 0) // Calibrated before
+    batteryScale = stored;
+  halAdcStart(batteryValue); // About 100 us per conversion
+}
+
+// Picks up a finished conversion and starts the next one. Never waits for the ADC like analogRead() does, so the control loop keeps its timing
+void monitorBattery()
+{
+  if (!halAdcDone()) // Conversion still running
+    return;
+  batterySum += halAdcValue();
+  halAdcStart(batteryValue);
+  if (++batterySamples < batteryOversampling)
+    return;
+
+  long millivolts = (unsigned long)batterySum * batteryScale >> 16;
+  batterySum = 0;
+  batterySamples = 0;
+  if (batteryFiltered < 0) // First measurement, don't start from 0 V
+    batteryFiltered = millivolts << 4;
+  else // Slow filter of about 2 s, so a short sag under full throttle doesn't trigger the cutback
+    batteryFiltered += ((millivolts << 4) - batteryFiltered) >> 8;
+  telemetry.batteryVoltage = batteryFiltered >> 4;
+  updateBatteryState();
+}
+
+// Moves between the battery states. The cutback ends when the voltage recovers, the cutoff stays until the vehicle is restarted
+void updateBatteryState()
+{
+  if (config.batteryType == 0 || config.batteryType >= sizeof(batteryPresets) / sizeof(batteryPresets[0]))
+  {
+    telemetry.batteryState = batteryOk;
+    return;
+  }
+  const batteryPreset &preset = batteryPresets[config.batteryType];
+  byte cells = constrain(config.batteryCells, 1, 8);
+  unsigned int cutback = preset.cutback * cells;
+  unsigned int cutoff = preset.cutoff * cells;
+  unsigned int recovered = cutback + (cutback - cutoff) / 2; // Hysteresis, a battery recovers a bit when the load is gone
+  unsigned int voltage = telemetry.batteryVoltage;
+
+  if (telemetry.batteryState == batteryCutoff)
+    return;
+  if (voltage < cutoff)
+  {
+    telemetry.batteryState = batteryCutoff;
+    tone(horn, 440, 1000);
+  }
+  else if (voltage < cutback && telemetry.batteryState == batteryOk)
+  {
+    telemetry.batteryState = batteryCutback;
+    tone(horn, 440, 200);
+  }
+  else if (voltage > recovered)
+    telemetry.batteryState = batteryOk;
+}
+
+// Halves the throttle around neutral in the cutback state and keeps the motor at neutral after the cutoff
+int limitThrottle(int throttle)
+{
+  int neutral = 90 + constrain(config.throttleTrim, -30, 30);
+  if (telemetry.batteryState == batteryCutoff)
+    return neutral;
+  if (telemetry.batteryState == batteryCutback)
+    return neutral + (throttle - neutral) / 2;
+  return throttle;
+}
+
+// Corrects the scale of the battery input to the voltage measured with a multimeter, and stores it in the EEPROM
+void calibrateBattery(unsigned long millivolts)
+{
+  if (telemetry.batteryVoltage == 0 || millivolts == 0)
+    return;
+  unsigned long scale = (unsigned long)batteryScale * millivolts / telemetry.batteryVoltage;
+  if (scale == 0 || scale >= 0xFFFF)
+    return;
+  batteryScale = scale;
+  batteryFiltered = (long)millivolts << 4;
+  telemetry.batteryVoltage = millivolts;
+  EEPROM.put(eepromBatteryScale, batteryScale);
+  printf("battery calibrated: %u mV full scale\n", batteryScale);
+}
+
+char serialLine[16];    // Command that is being received on the serial monitor
+byte serialLength = 0;  // Characters in serialLine
+// Reads commands from the serial monitor without blocking. "cal 11850" calibrates the battery voltage to 11.85 V measured with a multimeter,
+// "box" prints the records of the black box and "box clear" empties them
+void readSerial()
+{
+  while (Serial.available())
+  {
+    char c = Serial.read();
+    if (c != '\n' && c != '\r')
+    {
+      if (serialLength < sizeof(serialLine) - 1)
+        serialLine[serialLength++] = c;
+      continue;
+    }
+    serialLine[serialLength] = '\0';
+    serialLength = 0;
+    if (strncmp(serialLine, "cal ", 4) == 0)
+      calibrateBattery(atol(serialLine + 4));
+    else if (strcmp(serialLine, "box") == 0)
+      dumpBlackBox();
+    else if (strcmp(serialLine, "box clear") == 0)
+      clearBlackBox();
+  }
+}
+
+// Throttle shaper
+const byte shaperTick = 2;              // ms between two updates of the motor output, independent of the packages
+const byte launchDeadband = 20;         // us around neutral that count as standing still
+const byte launchRamp[] = {40, 55, 70, 85, 100}; // % of the throttle over the launch time
+int throttleTarget = throttleMicros(90); // us, throttle asked for by the active mode
+int throttleOutput = throttleMicros(90); // us, pulse width sent to the motor controller
+unsigned long lastShape = 0;            // micros() of the last update of the motor output
+unsigned long softStartAt = 0;          // millis() of the last moment in failsafe, the throttle opens up again from there
+unsigned long lastMoving = 0;           // millis() of the last update with the motor output away from neutral
+unsigned long launchAt = 0;             // millis() of the start of the current launch
+bool launching = false;                 // The launch ramp limits the throttle
+bool launchArmed = false;               // Standing still long enough, the next drive off is a launch
+
+// Converts a throttle position in degrees to a pulse width, the same way as Servo::write()
+int throttleMicros(int degrees)
+{
+  return map(constrain(degrees, 0, 180), 0, 180, MIN_PULSE_WIDTH, MAX_PULSE_WIDTH);
+}
+
+// Sets the throttle the shaper moves the motor output to
+void setThrottle(int degrees)
+{
+  throttleTarget = throttleMicros(degrees);
+}
+
+// Moves the motor output to the target at a fixed tick, so it behaves the same at every package rate. Limits how fast the throttle moves,
+// opens up the throttle slowly after a failsafe and follows the launch ramp when driving off from a standstill
+void shapeThrottle()
+{
+  if (micros() - lastShape < shaperTick * 1000UL)
+    return;
+  if (micros() - lastShape > 4 * shaperTick * 1000UL) // The loop was held up, don't make up for the missed ticks
+    lastShape = micros();
+  else
+    lastShape += shaperTick * 1000UL;
+  unsigned long now = millis();
+  int neutral = throttleMicros(90 + constrain(config.throttleTrim, -30, 30));
+  long target = throttleTarget - neutral; // Relative to neutral from here on
+  long output = throttleOutput - neutral;
+
+  if (micros() - lastReceive > config.holdTime * 10000UL) // In failsafe, the soft start begins when the remote is back
+    softStartAt = now;
+  else if (config.softStart > 0 && now - softStartAt < config.softStart * 10UL)
+    target = target * (long)(now - softStartAt) / (config.softStart * 10L);
+
+  if (abs(output) < launchDeadband) // Launch control
+  {
+    if (now - lastMoving >= 500)
+      launchArmed = config.launchTime > 0;
+  }
+  else
+    lastMoving = now;
+  if (launchArmed && abs(target) >= launchDeadband)
+  {
+    launchArmed = false;
+    launching = true;
+    launchAt = now;
+  }
+  if (launching)
+  {
+    unsigned long elapsed = now - launchAt;
+    unsigned long duration = config.launchTime * 10UL;
+    if (elapsed >= duration || abs(target) < launchDeadband) // Ramp done, or the driver let go
+      launching = false;
+    else
+    {
+      const byte steps = sizeof(launchRamp) - 1;
+      byte step = elapsed * steps / duration;
+      int fraction = (elapsed * steps % duration) * 256 / duration;
+      int percent = launchRamp[step] + ((launchRamp[step + 1] - launchRamp[step]) * fraction >> 8);
+      target = target * percent / 100;
+    }
+  }
+
+  bool accelerating = output == 0 || (output > 0) == (target > output); // Moving away from neutral
+  byte rate = accelerating ? config.accelRate : config.decelRate;
+  if (rate > 0)
+  {
+    if (rxData.mode == easy) // Gentler for beginners
+      rate = max(rate / 2, 1);
+    long change = constrain(target - output, -rate * shaperTick, rate * shaperTick);
+    if (accelerating == false && output != 0 && (output > 0) != (output + change > 0)) // Stop at neutral before reversing, from there on it's accelerating again
+      change = -output;
+    output += change;
+  }
+  else
+    output = target;
+  throttleOutput = neutral + output;
+  motorcontroller.writeMicroseconds(throttleOutput);
+}
+
+// Brake
+const byte escCar = 0; // ESC types
+const byte escCrawler = 1;
+const byte escNoReverse = 2;
+const byte driving = 0; // Phases of a car ESC on the way from driving forward to reverse
+const byte braking = 1;
+const byte neutralGap = 2;
+const byte reversing = 3;
+const byte brakeDeadband = 3;           // Degrees around neutral that count as neutral
+const int brakeRampTime = 500;          // ms the brake button has to be held for full brake
+const int brakeToReverse = 300;         // ms a car ESC brakes before the neutral gap when the throttle asks for reverse
+const int gapTime = 100;                // ms of neutral a car ESC needs to switch from brake to reverse
+unsigned long brakePressed = 0;         // millis() when the brake button was pressed
+byte escPhase = driving;                // Phase of a car ESC
+unsigned long phaseStart = 0;           // millis() of the start of escPhase
+
+// Strength of the brake, 0...100 %. Grows with the hold time of the brake button
+byte brakeStrength()
+{
+  byte strength = 0;
+  if (rxData.brake)
+  {
+    if (brakePressed == 0)
+      brakePressed = max(millis(), 1UL);
+    strength = min((millis() - brakePressed) * 100 / brakeRampTime, 100UL);
+  }
+  else
+    brakePressed = 0;
+  return strength;
+}
+
+// The one place where the brake and the throttle meet. A car ESC brakes on reverse pulses after driving forward and only reverses after a gap at neutral,
+// a crawler ESC reverses right away so it gets neutral to brake on its drag brake, an ESC without reverse brakes on every reverse pulse
+int arbitrateBrake(int throttle, int neutral, int fullReverse)
+{
+  unsigned long now = millis();
+  byte strength = brakeStrength();
+  if (strength > 0)
+  {
+    if (config.escType == escCrawler)
+      return neutral;
+    if (escPhase != braking)
+    {
+      escPhase = braking;
+      phaseStart = now;
+    }
+    if (config.absRate > 0 && now % (1000 / config.absRate) >= 500 / config.absRate) // ABS, let the wheels turn again half of every period
+      return neutral;
+    return neutral + (long)(fullReverse - neutral) * strength / 100;
+  }
+
+  if (config.escType != escCar)
+    return throttle;
+  if (throttle > neutral + brakeDeadband) // Forward
+    escPhase = driving;
+  else if (throttle < neutral - brakeDeadband) // Reverse asked for
+  {
+    if (escPhase == driving) // The ESC brakes on the first reverse pulses
+    {
+      escPhase = braking;
+      phaseStart = now;
+    }
+    if (escPhase == braking && now - phaseStart >= brakeToReverse)
+    {
+      escPhase = neutralGap;
+      phaseStart = now;
+    }
+    if (escPhase == neutralGap)
+    {
+      if (now - phaseStart < gapTime)
+        return neutral;
+      escPhase = reversing;
+    }
+  }
+  else if (escPhase == braking) // Stick at neutral after braking, that counts as the gap
+  {
+    escPhase = neutralGap;
+    phaseStart = now;
+  }
+  return throttle;
+}
+
+// Mixer
+struct mixOp // Line of the mixer table compiled to fixed point
+{
+  uint8_t source;
+  uint8_t output;
+  uint8_t curve;
+  int16_t weight; // 1/256
+  int16_t offset; // Same scale as the inputs
+};
+const mixLine defaultMix[mixLines] = { // Steering and throttle straight through, the same as the normal preset of the remote
+    {mixSteer, outSteering, 100, 0, 0},
+    {mixThrottle, outMotor, 100, 0, 0},
+    {mixHeadLight, outHeadLight, 100, 0, 0},
+    {mixTailLight, outTailLight, 100, 0, 0},
+    {mixBrake, outTailLight, 100, 0, 0},
+    {mixHonk, outHorn, 100, 0, 0},
+    {0xFF, 0, 0, 0, 0},
+    {0xFF, 0, 0, 0, 0}};
+mixOp mixOps[mixLines];                 // Compiled mixer table, only the used lines
+byte mixOpCount = 0;                    // Used entries of mixOps
+byte mixDriven = 0;                     // Outputs that are driven by a line, bit 0 = outSteering
+
+// Converts a servo position in degrees to the scale of the mixer
+int toMix(int degrees)
+{
+  return (long)(degrees - 90) * 512 / 90;
+}
+
+// Converts a mixer output to a servo position in degrees, rounded so toMix() and fromMix() give back the same position
+int fromMix(int value)
+{
+  long scaled = (long)value * 90;
+  return 90 + (scaled + (scaled < 0 ? -256 : 256)) / 512;
+}
+
+// Reads the mixer table from the EEPROM, the default table is used when the EEPROM holds none or an older layout
+void loadMixer()
+{
+  memcpy(mixTable, defaultMix, sizeof(mixTable));
+  if (EEPROM.read(eepromMixerSize) == sizeof(mixTable))
+    EEPROM.get(eepromMixer, mixTable);
+  compileMixer();
+}
+
+// Stores one byte of the mixer table sent by the remote. Only changed bytes are written to the EEPROM
+void updateMixer(byte index, byte value)
+{
+  byte *bytes = (byte *)mixTable;
+  if (index >= sizeof(mixTable) || bytes[index] == value)
+    return;
+  bytes[index] = value;
+  compileMixer();
+  if (EEPROM.read(eepromMixerSize) == sizeof(mixTable))
+    EEPROM.update(eepromMixer + index, value);
+  else // First table in this layout, store the other bytes too
+  {
+    EEPROM.put(eepromMixer, mixTable);
+    EEPROM.update(eepromMixerSize, sizeof(mixTable));
+  }
+}
+
+// Turns the mixer table into a flat list of fixed point operations, unused and invalid lines are left out. Attaches the extra servos that are driven
+void compileMixer()
+{
+  mixOpCount = 0;
+  mixDriven = 0;
+  for (byte i = 0; i < mixLines; i++)
+  {
+    const mixLine &line = mixTable[i];
+    if (line.source >= mixInputs || line.output >= mixOutputs)
+      continue;
+    mixOp &op = mixOps[mixOpCount++];
+    op.source = line.source;
+    op.output = line.output;
+    op.curve = line.curve;
+    op.weight = constrain(line.weight, -100, 100) * 256 / 100;
+    op.offset = constrain(line.offset, -100, 100) * 512 / 100;
+    mixDriven |= 1 << line.output;
+  }
+  if (mixDriven & (1 << outAux1))
+  {
+    if (!auxServo1.attached())
+    {
+      auxServo1.write(90); // Neutral from the first pulse, like the motor controller
+      auxServo1.attach(aux1Pin);
+    }
+  }
+  else
+    auxServo1.detach();
+  if (mixDriven & (1 << outAux2))
+  {
+    if (!auxServo2.attached())
+    {
+      auxServo2.write(90);
+      auxServo2.attach(aux2Pin);
+    }
+  }
+  else
+    auxServo2.detach();
+}
+
+// Runs the compiled mixer on mixIn and updates all outputs. Outputs without a line stay at neutral, or off
+void runMixer()
+{
+  long out[mixOutputs] = {0};
+  mixIn[mixFull] = 511; // Constant input, for offsets that follow a switch
+  for (byte i = 0; i < mixOpCount; i++)
+  {
+    const mixOp &op = mixOps[i];
+    int value = mixIn[op.source];
+    if ((op.curve == 1 && value < 0) || (op.curve == 2 && value > 0))
+      value = 0;
+    else if (op.curve == 3 && value < 0)
+      value = -value;
+    out[op.output] += ((long)value * op.weight >> 8) + op.offset;
+  }
+  for (byte i = 0; i < mixOutputs; i++)
+    out[i] = constrain(out[i], -512, 511);
+
+  servo.write(constrain(fromMix(out[outSteering]), 0, 180));
+  setThrottle(fromMix(out[outMotor])); // Through the throttle shaper
+  if (auxServo1.attached())
+    auxServo1.write(constrain(fromMix(out[outAux1]), 0, 180));
+  if (auxServo2.attached())
+    auxServo2.write(constrain(fromMix(out[outAux2]), 0, 180));
+  digitalWrite(headLight, out[outHeadLight] > 0 ? HIGH : LOW);
+  digitalWrite(tailLight, out[outTailLight] > 0 ? HIGH : LOW);
+  if (out[outHorn] > 0)
+    tone(horn, 220, 500);
+}
+
+// Black box
+struct blackBoxSample // State of the vehicle at one moment, the samples are boxPeriod apart
+{
+  uint8_t steering; // (us - 500) / 8, pulse width of the steering servo
+  uint8_t throttle; // (us - 500) / 8, pulse width of the motor controller
+  uint8_t mode;     // rxData.mode
+  uint8_t linkGap;  // x10 ms since the last valid package, 255 = 2.55 s or longer
+  uint8_t battery;  // x128 mV, filtered voltage of the battery
+  uint8_t flags;    // boxFlag bits
+};
+
+struct blackBoxHeader // Start of a record in the EEPROM, the samples follow it, oldest first
+{
+  uint8_t event;   // Cause of the record, boxEmpty = no record, or one that is being written
+  uint8_t number;  // Counts up with every record, the slot after the newest record is written next
+  uint8_t count;   // Samples in the record
+  uint16_t uptime; // s since the start of the vehicle at the event, 0 for a reset
+} __attribute__((packed));
+
+const byte boxEmpty = 0xFF;         // Events, the cause of a record
+const byte boxEventFailsafe = 1;
+const byte boxEventCutoff = 2;
+const byte boxEventWatchdog = 3;
+const byte boxEventBrownout = 4;
+const char *const boxEventNames[] = {"", "failsafe", "battery cutoff", "watchdog reset", "brownout reset"};
+const byte boxFlagFailsafe = 1;     // Flags of a sample: no package for longer than the hold time while driving, or not connected
+const byte boxFlagCutback = 2;      // Battery in the cutback state
+const byte boxFlagCutoff = 4;       // Battery in the cutoff state
+const byte boxFlagInvalid = 8;      // A package was rejected since the last sample
+const byte boxFlagRace = 16;        // Race link
+const byte boxFlagHopping = 32;     // Frequency hopping
+const byte boxFlagBrake = 64;       // Brake button held
+const byte boxFlagLaunch = 128;     // Launch ramp running
+const byte boxSamples = 40;         // Samples in the RAM log, 8 s
+const unsigned int boxPeriod = 200; // ms between samples
+const byte boxAfterEvent = 10;      // Samples taken after a failsafe or cutoff before the record is written, so it shows what followed
+const unsigned long boxHoldOff = 30000; // ms after a failsafe record in which the next failsafe isn't recorded, the first of a series is kept
+const uint16_t boxMagic = 0xB0C5;   // Part of the checksum, so RAM that is all 0 doesn't pass
+const int boxSlotSize = sizeof(blackBoxHeader) + boxSamples * sizeof(blackBoxSample);
+const byte boxSlots = (E2END + 1 - eepromBlackBox) / boxSlotSize; // Records the EEPROM holds, they are written in turn
+static_assert(boxSlots > 0, "no room for a black box record in the EEPROM");
+blackBoxSample boxRing[boxSamples] HAL_NOINIT; // Last samples, kept over a watchdog or brownout reset
+byte boxNext HAL_NOINIT;                       // Index in boxRing the next sample goes to
+byte boxCount HAL_NOINIT;                      // Samples in boxRing
+uint16_t boxCheck HAL_NOINIT;                  // blackBoxChecksum() of the ring, tells a kept ring apart from the random RAM after power-on
+unsigned long lastBoxSample = 0;               // millis() of the last sample
+byte boxEvent = 0;                             // Event that waits to be recorded, 0 = none
+byte boxWait = 0;                              // Samples still taken before the record of boxEvent is written
+int boxWritten = -1;                           // Bytes of the record written to the EEPROM so far, -1 = not writing. Sampling pauses meanwhile
+uint16_t boxUptime = 0;                        // uptime of the record that is written
+byte boxSlot = 0;                              // Slot of the EEPROM the next record goes to
+byte boxNumber = 0;                            // number of the next record
+unsigned long lastFailsafeRecord = 0;          // millis() of the last failsafe event that was recorded, 0 = none yet
+bool boxFailsafe = false;                      // In failsafe at the last sample
+bool boxCutoff = false;                        // Battery cutoff at the last sample
+int boxDumpLine = -1;                          // Next line of the dump on the serial monitor, -1 = no dump
+
+// Checksum of the ring and its indices, rotated so samples that moved change it too
+uint16_t blackBoxChecksum()
+{
+  uint16_t sum = boxMagic + boxNext + (boxCount << 8);
+  const byte *bytes = (const byte *)boxRing;
+  for (unsigned int i = 0; i < sizeof(boxRing); i++)
+    sum = (sum << 1 | sum >> 15) + bytes[i];
+  return sum;
+}
+
+// Finds the slot after the newest record. Records the samples from before a watchdog or brownout reset, they are still in RAM
+void startBlackBox()
+{
+  bool found = false;
+  byte newest = 0;
+  for (byte slot = 0; slot < boxSlots; slot++)
+  {
+    blackBoxHeader header;
+    EEPROM.get(eepromBlackBox + slot * boxSlotSize, header);
+    if (header.event == boxEmpty || (found && (int8_t)(header.number - newest) < 0))
+      continue;
+    found = true;
+    newest = header.number;
+    boxSlot = (slot + 1) % boxSlots;
+  }
+  boxNumber = found ? newest + 1 : 0;
+
+  byte resetFlags = halResetFlags();
+  bool kept = (resetFlags & halResetPowerOn) == 0 && boxNext < boxSamples && boxCount <= boxSamples && boxCheck == blackBoxChecksum();
+  if (!kept)
+  {
+    boxNext = 0;
+    boxCount = 0;
+    boxCheck = blackBoxChecksum();
+  }
+  else if (boxCount > 0 && (resetFlags & (halResetWatchdog | halResetBrownout)))
+  {
+    boxEvent = resetFlags & halResetWatchdog ? boxEventWatchdog : boxEventBrownout;
+    boxUptime = 0;
+    boxWritten = 0; // Written while the vehicle starts up and waits for the remote
+  }
+}
+
+// Takes a sample every boxPeriod and starts a record on an event. Writes the record and the dump a bit per pass, never waits
+void recordBlackBox()
+{
+  writeBlackBox();
+  printBlackBox();
+  if (boxWritten >= 0 || millis() - lastBoxSample < boxPeriod)
+    return;
+  lastBoxSample = millis();
+
+  unsigned long silence = micros() - lastReceive;
+  bool silent = lastReceive != 0 && silence > config.holdTime * 10000UL;
+  bool failsafe = silent && (rxData.mode == easy || rxData.mode == pro); // Only there applyFailsafe() acts, in idle and debug the remote sends slower than the hold time
+  bool cutoff = telemetry.batteryState == batteryCutoff;
+  blackBoxSample &sample = boxRing[boxNext];
+  sample.steering = constrain((servo.readMicroseconds() - 500) / 8, 0, 255);
+  sample.throttle = constrain((throttleOutput - 500) / 8, 0, 255);
+  sample.mode = rxData.mode;
+  sample.linkGap = lastReceive == 0 ? 255 : min(silence / 10000, 255UL);
+  sample.battery = min(telemetry.batteryVoltage / 128, 255);
+  sample.flags = (failsafe || (silent && rxData.mode == notConnected) ? boxFlagFailsafe : 0) | (telemetry.batteryState == batteryCutback ? boxFlagCutback : 0) | (cutoff ? boxFlagCutoff : 0) |
+                 (invalidSeen ? boxFlagInvalid : 0) | (raceLink ? boxFlagRace : 0) | (hopIndex != noHopping ? boxFlagHopping : 0) |
+                 (rxData.brake ? boxFlagBrake : 0) | (launching ? boxFlagLaunch : 0);
+  invalidSeen = false;
+  boxNext = (boxNext + 1) % boxSamples;
+  boxCount = min(boxCount + 1, (int)boxSamples);
+  boxCheck = blackBoxChecksum();
+
+  if (failsafe && !boxFailsafe && (lastFailsafeRecord == 0 || millis() - lastFailsafeRecord > boxHoldOff))
+  {
+    lastFailsafeRecord = max(millis(), 1UL);
+    triggerBlackBox(boxEventFailsafe);
+  }
+  if (cutoff && !boxCutoff)
+    triggerBlackBox(boxEventCutoff);
+  boxFailsafe = failsafe;
+  boxCutoff = cutoff;
+  if (boxEvent == 0)
+    return;
+  if (boxWait > 0)
+    boxWait--;
+  else
+    boxWritten = 0;
+}
+
+// Starts a record after the samples that follow the event. An event while another one waits or is written is left out
+void triggerBlackBox(byte event)
+{
+  if (boxEvent != 0)
+    return;
+  boxEvent = event;
+  boxWait = boxAfterEvent;
+  boxUptime = min(millis() / 1000, 0xFFFFUL);
+}
+
+// Writes one byte of the record when the EEPROM is ready for it, a record takes about 1 s. The header is invalidated first and its event
+// byte written last, so a record that a reset cut off isn't taken for a complete one. Only changed bytes are written
+void writeBlackBox()
+{
+  if (boxWritten < 0 || !halEepromReady())
+    return;
+  int address = eepromBlackBox + boxSlot * boxSlotSize;
+  int samplesSize = boxCount * sizeof(blackBoxSample);
+  if (boxWritten == 0)
+    EEPROM.update(address, boxEmpty);
+  else if (boxWritten <= samplesSize)
+  {
+    int offset = boxWritten - 1;
+    byte oldest = boxCount < boxSamples ? 0 : boxNext;
+    const byte *sample = (const byte *)&boxRing[(oldest + offset / sizeof(blackBoxSample)) % boxSamples];
+    EEPROM.update(address + sizeof(blackBoxHeader) + offset, sample[offset % sizeof(blackBoxSample)]);
   }
-}
\ No newline at end of file
+  else
+  {
+    blackBoxHeader header = {boxEvent, boxNumber, boxCount, boxUptime};
+    int offset = (boxWritten - samplesSize) % sizeof(blackBoxHeader); // 1...4, then 0 for the event byte
+    EEPROM.update(address + offset, ((const byte *)&header)[offset]);
+    if (offset == 0)
+    {
+      boxWritten = -1;
+      boxEvent = 0;
+      boxSlot = (boxSlot + 1) % boxSlots;
+      boxNumber++;
+      return;
+    }
+  }
+  boxWritten++;
+}
+
+// Starts printing the records on the serial monitor, oldest first
+void dumpBlackBox()
+{
+  boxDumpLine = 0;
+}
+
+// Prints one line of the dump when it fits in the transmit buffer of the serial port, so the dump doesn't hold up the loop at 9600 baud.
+// A record starts with a line about its event, then a line per sample: ms before the last sample, mode, steering us, throttle us,
+// ms since the last package, battery mV and the flags
+void printBlackBox()
+{
+  if (boxDumpLine < 0 || boxWritten >= 0 || Serial.availableForWrite() < 48)
+    return;
+  byte turn = boxDumpLine / (boxSamples + 1); // Records of the dump, oldest slot first
+  byte line = boxDumpLine % (boxSamples + 1);
+  if (turn >= boxSlots)
+  {
+    printf("black box end\n");
+    boxDumpLine = -1;
+    return;
+  }
+  int address = eepromBlackBox + (boxSlot + turn) % boxSlots * boxSlotSize;
+  blackBoxHeader header;
+  EEPROM.get(address, header);
+  if (header.event == boxEmpty || header.event >= sizeof(boxEventNames) / sizeof(boxEventNames[0]) || header.count > boxSamples)
+  {
+    boxDumpLine = (turn + 1) * (boxSamples + 1);
+    return;
+  }
+  if (line == 0)
+    printf("black box record %i: %s at %u s, %i samples\n", header.number, boxEventNames[header.event], header.uptime, header.count);
+  else
+  {
+    blackBoxSample sample;
+    EEPROM.get(address + sizeof(blackBoxHeader) + (line - 1) * sizeof(blackBoxSample), sample);
+    printf("%li,%i,%i,%i,%i,%u,%i\n", -(long)(header.count - line) * boxPeriod, sample.mode, 500 + sample.steering * 8, 500 + sample.throttle * 8,
+           sample.linkGap * 10, sample.battery * 128, sample.flags);
+  }
+  boxDumpLine = line < header.count ? boxDumpLine + 1 : (turn + 1) * (boxSamples + 1);
+}
+
+// Empties the records in the EEPROM, not while one is written
+void clearBlackBox()
+{
+  if (boxWritten >= 0)
+    return;
+  for (byte slot = 0; slot < boxSlots; slot++)
+    EEPROM.update(eepromBlackBox + slot * boxSlotSize, boxEmpty);
+  boxSlot = 0;
+  boxNumber = 0;
+  printf("black box cleared\n");
+}
@@ -0,0 +1,693 @@
+/*  Tests of the control pipeline of the vehicle: validation of the packages, the steering and throttle mapping, the failsafe timing, the modes of
+    the state machine and the accessories. The program is compiled in, on a board of the Linux backend with a virtual clock and a simulated air,
+    so the clock and the radio of the remote are in the hands of the tests.
+    The sweeps run over the whole range of their inputs. Where the exact outputs matter they are folded into a digest, a rewrite of these paths
+    has to give the same digest, or explain why it doesn't.
+
+    Run with: pio test -e native
+*/
+
+#include <unity.h>
+#include <Arduino.h> // The headers of the program, so the define below only reaches the program itself
+#include <LibPrintf.h>
+#include <Servo.h>
+#include <EEPROM.h>
+#include <hal.h>
+#include <SPI.h>
+#include <nRF24L01.h>
+#include <RF24.h>
+#include <hal_linux.h>
+#include <hal_sim_air.h>
+
+halSimAir air; // Before the program, so it outlives the radio of the program at exit
+
+#define printf silentPrintf // validateData() prints every rejected package, the sweeps reject a few hundred thousand
+int silentPrintf(const char *format, ...)
+{
+  (void)format;
+  return 0;
+}
+#include "../../src/main.cpp"
+#undef printf
+
+// Prototypes
+void passLoops(unsigned int count);
+void receive(dataPackage package);
+dataPackage drivingPackage();
+int steeringFor(int leftX);
+int throttleFor(int rightY);
+void expectValid(const dataPackage &package, bool expected, const char *field, int value);
+void fold(uint32_t *digest, int value);
+
+// Global variables
+const byte steeringPin = 5;     // servo.attach(5) in setup()
+const unsigned int loopMicros = 250; // us one pass of loop() takes on the Pro Mini, besides the clock reads and the radio
+const uint32_t digestStart = 2166136261u; // FNV-1a
+const uint32_t steeringDigest = 0x992F9209; // Digests of the sweeps, taken from the outputs of today's pipeline
+const uint32_t throttleDigest = 0x99FCF6D4;
+const uint32_t expoDigest = 0x1C0F0C9C;
+RF24 remoteRadio(0, 1); // Stands in for the remote
+bindPackage remoteBinding; // Address and channel the vehicle is bound to
+byte sequence = 0;
+
+void setUp()
+{
+  config = vehicleConfig();
+  buildSteerSchedule();
+  memcpy(mixTable, defaultMix, sizeof(mixTable));
+  compileMixer();
+  rxData = drivingPackage();
+  telemetry.batteryState = 0;
+  escPhase = driving;
+  brakePressed = 0;
+  lastReceive = micros();
+  setLink(false); // A silent stretch in an earlier test may have left the radio searching on the race link
+  noTone(horn);
+  digitalWrite(interferenceLED, LOW);
+}
+
+void tearDown()
+{
+}
+
+// Every stick accepts 0...1023 and -1 for uninitialized, nothing else
+void test_validate_sticks()
+{
+  int16_t dataPackage::*sticks[] = {&dataPackage::rightX, &dataPackage::leftX, &dataPackage::rightY, &dataPackage::leftY};
+  const char *names[] = {"rightX", "leftX", "rightY", "leftY"};
+  for (byte i = 0; i < 4; i++)
+  {
+    for (long value = INT16_MIN; value <= INT16_MAX; value++)
+    {
+      dataPackage package = drivingPackage();
+      package.*sticks[i] = value;
+      expectValid(package, value >= -1 && value <= 1023, names[i], value);
+    }
+  }
+}
+
+// The modes 0...3 come from the remote, 4 (not connected) and 5 (binding) only exist on the vehicle
+void test_validate_mode()
+{
+  for (int value = INT8_MIN; value <= INT8_MAX; value++)
+  {
+    dataPackage package = drivingPackage();
+    package.mode = value;
+    expectValid(package, value >= 0 && value <= 3, "mode", value);
+  }
+}
+
+void test_validate_sensitivities()
+{
+  for (int value = INT8_MIN; value <= INT8_MAX; value++)
+  {
+    dataPackage package = drivingPackage();
+    package.throttleSensitifity = value;
+    expectValid(package, value >= -1 && value <= 100, "throttleSensitifity", value);
+    package = drivingPackage();
+    package.steerSensitifity = value;
+    expectValid(package, value >= -1 && value <= 100, "steerSensitifity", value);
+  }
+}
+
+// A package carries a byte of vehicleConfig or of the mixer table, the gap between them is invalid
+void test_validate_config_index()
+{
+  for (int value = 0; value <= 255; value++)
+  {
+    dataPackage package = drivingPackage();
+    package.configIndex = value;
+    bool valid = value < (int)sizeof(vehicleConfig) || (value >= mixerConfigIndex && value < mixerConfigIndex + (int)sizeof(mixTable));
+    expectValid(package, valid, "configIndex", value);
+  }
+}
+
+void test_validate_hop_index()
+{
+  for (int value = 0; value <= 255; value++)
+  {
+    dataPackage package = drivingPackage();
+    package.hopIndex = value;
+    expectValid(package, value < hopCount || value == noHopping, "hopIndex", value);
+  }
+}
+
+// The race link sends 1...4 copies, numbered from 0. The number of the copy doesn't matter on the ARQ link
+void test_validate_copies()
+{
+  for (int copies = 0; copies <= 255; copies++)
+  {
+    for (int copy = 0; copy <= 255; copy++)
+    {
+      dataPackage package = drivingPackage();
+      package.copies = copies;
+      package.copy = copy;
+      expectValid(package, copies == 0 || (copies <= 4 && copy < copies), "copies", copies * 256 + copy);
+    }
+  }
+}
+
+// The buttons and switches are bools, a byte other than 0 or 1 in their place isn't a package of the remote
+void test_validate_booleans()
+{
+  for (byte flag = 0; flag < flagCount; flag++)
+  {
+    for (int value = 0; value <= 255; value++)
+    {
+      dataPackage package = drivingPackage();
+      ((byte *)&package.rightJoystickButton)[flag] = value;
+      expectValid(package, value <= 1, "flag", flag * 256 + value);
+    }
+  }
+}
+
+// applyExpo() keeps the ends and the center, never leaves the stick range and never reverses the direction of the stick
+void test_expo_sweep()
+{
+  uint32_t digest = digestStart;
+  for (int expo = 0; expo <= 255; expo++)
+  {
+    TEST_ASSERT_EQUAL(-1, applyExpo(-1, expo));
+    TEST_ASSERT_EQUAL(512, applyExpo(512, expo));
+    int previous = 0;
+    for (int value = 0; value <= 1023; value++)
+    {
+      int curved = applyExpo(value, expo);
+      TEST_ASSERT_TRUE(curved >= previous && curved <= 1023);
+      TEST_ASSERT_EQUAL(applyExpo(value, min(expo, 100)), curved); // Expo above 100 % counts as 100 %
+      previous = curved;
+      fold(&digest, curved);
+    }
+  }
+  TEST_ASSERT_EQUAL_HEX32(expoDigest, digest);
+}
+
+// Steering over every stick position, sensitivity and a range of throttle positions, with and without the steering schedule.
+// The uninitialized sensitivity of -1 keeps the steering centered, it isn't part of the digest
+void test_steering_sweep()
+{
+  const int speeds[] = {0, 128, 256, 384, 512, 640, 768, 896, 1023};
+  uint32_t digest = digestStart;
+  config.escType = escNoReverse;
+  for (byte scheduled = 0; scheduled < 2; scheduled++)
+  {
+    config.steerAtSpeed = scheduled ? 50 : 100;
+    config.steerExpo = scheduled ? 20 : 0;
+    config.speedExpo = scheduled ? 40 : 0;
+    buildSteerSchedule();
+    for (int sensitivity = -1; sensitivity <= 100; sensitivity++)
+    {
+      rxData.steerSensitifity = sensitivity;
+      for (int speed : speeds)
+      {
+        rxData.rightY = speed;
+        int previous = MIN_PULSE_WIDTH;
+        for (int leftX = 0; leftX <= 1023; leftX++)
+        {
+          int pulse = steeringFor(leftX);
+          TEST_ASSERT_TRUE(pulse >= previous && pulse <= MAX_PULSE_WIDTH);
+          previous = pulse;
+          if (sensitivity >= 0)
+            fold(&digest, pulse);
+        }
+        if (sensitivity <= 0)
+          TEST_ASSERT_EQUAL(throttleMicros(90), previous);
+      }
+    }
+  }
+  TEST_ASSERT_EQUAL_HEX32(steeringDigest, digest);
+}
+
+// The steering schedule takes away steering range at speed, in both directions of the throttle
+void test_steering_less_range_at_speed()
+{
+  config.steerAtSpeed = 50;
+  buildSteerSchedule();
+  rxData.steerSensitifity = 100;
+  rxData.rightY = 512;
+  int standing = steeringFor(0);
+  rxData.rightY = 1023;
+  int forward = steeringFor(0);
+  rxData.rightY = 0;
+  int reverse = steeringFor(0);
+  TEST_ASSERT_TRUE(forward > standing);
+  TEST_ASSERT_TRUE(reverse > standing);
+  TEST_ASSERT_EQUAL(throttleMicros(0), standing);
+}
+
+void test_steering_trim()
+{
+  rxData.steerSensitifity = 0; // Steering stays at the center, plus the trim
+  for (int trim = INT8_MIN; trim <= INT8_MAX; trim++)
+  {
+    config.steerTrim = trim;
+    TEST_ASSERT_EQUAL(throttleMicros(90 + constrain(trim, -30, 30)), steeringFor(0));
+  }
+}
+
+// Throttle over every stick position, sensitivity and a few curves. An ESC without reverse leaves the brake out of it
+void test_throttle_sweep()
+{
+  const byte expos[] = {0, 25, 50, 100};
+  uint32_t digest = digestStart;
+  config.escType = escNoReverse;
+  for (byte expo : expos)
+  {
+    config.throttleExpo = expo;
+    for (int sensitivity = 0; sensitivity <= 100; sensitivity++)
+    {
+      rxData.throttleSensitifity = sensitivity;
+      int previous = MIN_PULSE_WIDTH;
+      for (int rightY = 0; rightY <= 1023; rightY++)
+      {
+        int pulse = throttleFor(rightY);
+        TEST_ASSERT_TRUE(pulse >= previous && pulse <= MAX_PULSE_WIDTH);
+        previous = pulse;
+        fold(&digest, pulse);
+      }
+      if (sensitivity == 0)
+        TEST_ASSERT_EQUAL(throttleMicros(90), previous);
+    }
+  }
+  TEST_ASSERT_EQUAL_HEX32(throttleDigest, digest);
+}
+
+// The battery monitor halves the throttle in the cutback and stops the motor after the cutoff
+void test_throttle_battery_limits()
+{
+  config.escType = escNoReverse;
+  rxData.throttleSensitifity = 100;
+  telemetry.batteryState = batteryCutback;
+  TEST_ASSERT_EQUAL(throttleMicros(135), throttleFor(1023));
+  TEST_ASSERT_EQUAL(throttleMicros(45), throttleFor(0));
+  telemetry.batteryState = batteryCutoff;
+  TEST_ASSERT_EQUAL(throttleMicros(90), throttleFor(1023));
+}
+
+// A car ESC brakes on the first reverse pulses, then needs a gap at neutral before it reverses
+void test_throttle_car_esc_reverse()
+{
+  rxData.throttleSensitifity = 100;
+  TEST_ASSERT_TRUE(throttleFor(1023) > throttleMicros(90)); // Driving forward
+  TEST_ASSERT_EQUAL(throttleMicros(0), throttleFor(0));     // Braking
+  halAdvanceClock((brakeToReverse + 10) * 1000UL);
+  TEST_ASSERT_EQUAL(throttleMicros(90), throttleFor(0)); // Gap
+  halAdvanceClock((gapTime + 10) * 1000UL);
+  TEST_ASSERT_EQUAL(throttleMicros(0), throttleFor(0)); // Reversing
+}
+
+// The brake button overrules the throttle. A crawler ESC gets neutral, so its drag brake holds the vehicle
+void test_throttle_brake_button()
+{
+  rxData.throttleSensitifity = 100;
+  rxData.brake = true;
+  throttleFor(1023);
+  halAdvanceClock(brakeRampTime * 1000UL);
+  TEST_ASSERT_EQUAL(throttleMicros(0), throttleFor(1023)); // Full brake after the ramp
+  config.escType = escCrawler;
+  TEST_ASSERT_EQUAL(throttleMicros(90), throttleFor(1023));
+}
+
+// The Y axis of the steering stick doesn't brake, steering diagonally keeps the throttle
+void test_throttle_steering_stick()
+{
+  rxData.throttleSensitifity = 100;
+  int throttle = throttleFor(1023);
+  rxData.leftY = 0;
+  TEST_ASSERT_EQUAL(throttle, throttleFor(1023));
+}
+
+// The throttle is held during a short dropout, then ramps to the failsafe position until the cut time
+void test_failsafe_ramp()
+{
+  config.holdTime = 10;
+  config.cutTime = 25;
+  config.failsafeThrottle = 40;
+  int previous = 150;
+  for (unsigned long silence = 0; silence <= 400000; silence += 1000)
+  {
+    lastReceive = micros() - silence;
+    int throttle = applyFailsafe(150);
+    if (silence < config.holdTime * 10000UL)
+      TEST_ASSERT_EQUAL(150, throttle);
+    else if (silence >= config.cutTime * 10000UL)
+      TEST_ASSERT_EQUAL(40, throttle);
+    TEST_ASSERT_TRUE(throttle <= previous && throttle >= 40);
+    previous = throttle;
+  }
+  config.cutTime = 5; // Cut before the hold ends: failsafe right after the hold
+  lastReceive = micros() - 110000;
+  TEST_ASSERT_EQUAL(40, applyFailsafe(150));
+}
+
+// The vehicle counts as not connected after the lost time, 100 ms...2.5 s
+void test_connection_lost_time()
+{
+  for (int lostTime = 0; lostTime <= 255; lostTime++)
+  {
+    config.lostTime = lostTime;
+    unsigned long limit = constrain(lostTime, 10, 250) * 10000UL;
+    rxData.mode = easy;
+    lastReceive = micros() - (limit - 10);
+    isConnected();
+    TEST_ASSERT_EQUAL(easy, rxData.mode);
+    lastReceive = micros() - (limit + 10);
+    isConnected();
+    TEST_ASSERT_EQUAL(notConnected, rxData.mode);
+  }
+}
+
+// The first package of the remote connects the vehicle, the horn tells the driver
+void test_mode_connects()
+{
+  rxData.mode = notConnected;
+  dataPackage package = drivingPackage();
+  package.mode = idle;
+  receive(package);
+  TEST_ASSERT_EQUAL(idle, rxData.mode);
+  TEST_ASSERT_EQUAL(880, halToneFrequency(horn));
+}
+
+// The vehicle follows the mode of the remote. Idle centers the steering, easy mode steers
+void test_mode_follows_remote()
+{
+  dataPackage package = drivingPackage();
+  package.mode = idle;
+  package.leftX = 0;
+  receive(package);
+  TEST_ASSERT_EQUAL(idle, rxData.mode);
+  TEST_ASSERT_EQUAL(throttleMicros(90), halServoMicros(steeringPin));
+  package.mode = easy;
+  receive(package);
+  TEST_ASSERT_EQUAL(easy, rxData.mode);
+  TEST_ASSERT_TRUE(halServoMicros(steeringPin) < throttleMicros(90));
+}
+
+// Debug mode leaves the outputs where they are. The package that switches over still passes through the mode it arrives in
+void test_mode_debug_holds_outputs()
+{
+  dataPackage package = drivingPackage();
+  package.mode = debug;
+  package.leftX = 0;
+  receive(package);
+  TEST_ASSERT_EQUAL(debug, rxData.mode);
+  int steering = halServoMicros(steeringPin);
+  package.leftX = 1023;
+  receive(package);
+  TEST_ASSERT_EQUAL(1023, rxData.leftX);
+  TEST_ASSERT_EQUAL(steering, halServoMicros(steeringPin));
+}
+
+// Without packages the vehicle disconnects after the lost time and every output goes to its failsafe position
+void test_mode_silence_disconnects()
+{
+  config.failsafeSteer = 60;
+  config.failsafeThrottle = 70;
+  dataPackage package = drivingPackage();
+  package.leftX = 1023;
+  receive(package);
+  TEST_ASSERT_EQUAL(easy, rxData.mode);
+  passLoops(config.lostTime * 10000UL / loopMicros + 100);
+  TEST_ASSERT_EQUAL(notConnected, rxData.mode);
+  TEST_ASSERT_EQUAL(throttleMicros(60), halServoMicros(steeringPin));
+  TEST_ASSERT_EQUAL(throttleMicros(70), throttleTarget);
+}
+
+// The remote sends every third of the lost time in the idle mode, the vehicle stays on its link in between
+void test_link_idle_rate()
+{
+  config.lostTime = 250;
+  dataPackage package = drivingPackage();
+  package.mode = idle;
+  for (byte i = 0; i < 5; i++)
+  {
+    receive(package);
+    for (unsigned long pass = 0; pass < config.lostTime * 10000UL / 3 / loopMicros; pass++)
+    {
+      passLoops(1);
+      TEST_ASSERT_FALSE(raceLink);
+    }
+  }
+  TEST_ASSERT_EQUAL(idle, rxData.mode);
+}
+
+// An invalid package changes nothing but the interference LED
+void test_mode_invalid_package()
+{
+  dataPackage package = drivingPackage();
+  receive(package);
+  package.mode = 9;
+  receive(package);
+  TEST_ASSERT_EQUAL(easy, rxData.mode);
+  TEST_ASSERT_EQUAL(HIGH, halDigitalOutput(interferenceLED));
+}
+
+// Only packages of the length of a dataPackage are taken, a shorter one would leave the end of the last one in place
+void test_mode_package_length()
+{
+  dataPackage package = drivingPackage();
+  receive(package);
+  digitalWrite(interferenceLED, LOW);
+  package.mode = idle;
+  uint8_t payload[32] = {0};
+  memcpy(payload, &package, sizeof(package));
+  for (byte length = 0; length <= 32; length++)
+  {
+    if (length == sizeof(dataPackage))
+      continue;
+    ((dataPackage *)payload)->sequence = ++sequence;
+    TEST_ASSERT_TRUE(remoteRadio.write(payload, length));
+    remoteRadio.flush_rx();
+    passLoops(4);
+    TEST_ASSERT_EQUAL(easy, rxData.mode);
+  }
+  TEST_ASSERT_EQUAL(HIGH, halDigitalOutput(interferenceLED));
+}
+
+// Every button of the remote becomes a mixer input, the sticks are centered on 0
+void test_accessories_inputs()
+{
+  bool dataPackage::*buttons[] = {&dataPackage::auxButton1, &dataPackage::auxButton2, &dataPackage::headLight, &dataPackage::tailLight,
+                                  &dataPackage::honk, &dataPackage::brake};
+  const byte inputs[] = {mixAux1, mixAux2, mixHeadLight, mixTailLight, mixHonk, mixBrake};
+  for (byte i = 0; i < 6; i++)
+  {
+    rxData = drivingPackage();
+    updateAccessoires();
+    TEST_ASSERT_EQUAL(0, mixIn[inputs[i]]);
+    rxData.*buttons[i] = true;
+    updateAccessoires();
+    TEST_ASSERT_EQUAL(511, mixIn[inputs[i]]);
+  }
+  telemetry.batteryState = batteryCutback;
+  updateAccessoires();
+  TEST_ASSERT_EQUAL(511, mixIn[mixBatteryLow]);
+
+  int16_t dataPackage::*sticks[] = {&dataPackage::rightX, &dataPackage::leftX, &dataPackage::rightY, &dataPackage::leftY};
+  const byte stickInputs[] = {mixRightX, mixLeftX, mixRightY, mixLeftY};
+  for (byte i = 0; i < 4; i++)
+  {
+    for (int value = -1; value <= 1023; value++)
+    {
+      rxData.*sticks[i] = value;
+      updateAccessoires();
+      TEST_ASSERT_EQUAL(value < 0 ? 0 : value - 512, mixIn[stickInputs[i]]);
+    }
+  }
+}
+
+// The default mixer puts the lights on their pins, the brake on the tail light and the honk on the horn
+void test_accessories_outputs()
+{
+  rxData.headLight = true;
+  updateAccessoires();
+  runMixer();
+  TEST_ASSERT_EQUAL(HIGH, halDigitalOutput(headLight));
+  TEST_ASSERT_EQUAL(LOW, halDigitalOutput(tailLight));
+  TEST_ASSERT_EQUAL(0, halToneFrequency(horn));
+  rxData.headLight = false;
+  rxData.brake = true;
+  rxData.honk = true;
+  updateAccessoires();
+  runMixer();
+  TEST_ASSERT_EQUAL(LOW, halDigitalOutput(headLight));
+  TEST_ASSERT_EQUAL(HIGH, halDigitalOutput(tailLight));
+  TEST_ASSERT_EQUAL(220, halToneFrequency(horn));
+}
+
+// A failsafe is recorded in the black box with the samples before and after it. The EEPROM is written a byte per pass at most
+void test_black_box_failsafe()
+{
+  for (unsigned int i = 0; i < boxSamples * boxPeriod / 10; i++) // Driving long enough to fill the log, a package every 10 ms
+  {
+    receive(drivingPackage());
+    passLoops(10000 / loopMicros - 4);
+  }
+  clearBlackBox(); // Records of the failsafes in earlier tests
+  lastFailsafeRecord = 0;
+  uint8_t before[E2END + 1];
+  unsigned long passes = 0;
+  do
+  {
+    memcpy(before, halEepromData(), sizeof(before));
+    passLoops(1);
+    unsigned int changed = 0;
+    for (unsigned int i = 0; i < sizeof(before); i++)
+      changed += before[i] != halEepromData()[i];
+    TEST_ASSERT_LESS_OR_EQUAL(1, changed);
+    TEST_ASSERT_LESS_THAN(100000, ++passes); // 20 s without a record
+  } while (boxWritten >= 0 || boxEvent != 0 || halEepromData()[eepromBlackBox] == boxEmpty);
+  blackBoxHeader header;
+  EEPROM.get(eepromBlackBox, header);
+  TEST_ASSERT_EQUAL(boxEventFailsafe, header.event);
+  TEST_ASSERT_EQUAL(boxSamples, header.count);
+  blackBoxSample first, last;
+  EEPROM.get(eepromBlackBox + sizeof(blackBoxHeader), first);
+  EEPROM.get(eepromBlackBox + sizeof(blackBoxHeader) + (boxSamples - 1) * sizeof(blackBoxSample), last);
+  TEST_ASSERT_EQUAL(easy, first.mode);
+  TEST_ASSERT_BITS_LOW(boxFlagFailsafe, first.flags);
+  TEST_ASSERT_BITS_HIGH(boxFlagFailsafe, last.flags);
+  TEST_ASSERT_GREATER_OR_EQUAL(boxAfterEvent * boxPeriod / 10, last.linkGap); // The samples after the failsafe
+}
+
+// In the idle mode the remote sends slower than the hold time, that is no failsafe and leaves the black box alone
+void test_black_box_idle_rate()
+{
+  clearBlackBox();
+  lastFailsafeRecord = 0;
+  boxFailsafe = false;
+  dataPackage package = drivingPackage();
+  package.mode = idle;
+  for (unsigned long waited = 0; waited < 2 * boxHoldOff; waited += config.lostTime * 10 / 3)
+  {
+    receive(package);
+    passLoops(config.lostTime * 10000UL / 3 / loopMicros);
+  }
+  TEST_ASSERT_EQUAL(idle, rxData.mode);
+  TEST_ASSERT_EQUAL(0, boxEvent);
+  for (byte slot = 0; slot < boxSlots; slot++)
+    TEST_ASSERT_EQUAL(boxEmpty, halEepromData()[eepromBlackBox + slot * boxSlotSize]);
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  halSelectBoard(halNewBoard()); // Erased EEPROM, nothing is written to disk
+  halUseVirtualClock();
+  halSetAir(&air);
+  const uint8_t vehicleAddress[5] = {0x17, 0x42, 0xA5, 0x3C, 0xE1};
+  memcpy(remoteBinding.address, vehicleAddress, sizeof(remoteBinding.address));
+  remoteBinding.channel = 76;
+  remoteBinding.hopBands = 0xFF;
+  EEPROM.put(eepromBinding, remoteBinding); // Bound before, so setup() listens to the remote right away
+  setup();
+  remoteRadio.begin();
+  remoteRadio.enableDynamicPayloads();
+  remoteRadio.enableAckPayload();
+  remoteRadio.openWritingPipe(remoteBinding.address);
+  remoteRadio.setChannel(remoteBinding.channel);
+  remoteRadio.stopListening();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_validate_sticks);
+  RUN_TEST(test_validate_mode);
+  RUN_TEST(test_validate_sensitivities);
+  RUN_TEST(test_validate_config_index);
+  RUN_TEST(test_validate_hop_index);
+  RUN_TEST(test_validate_copies);
+  RUN_TEST(test_validate_booleans);
+  RUN_TEST(test_expo_sweep);
+  RUN_TEST(test_steering_sweep);
+  RUN_TEST(test_steering_less_range_at_speed);
+  RUN_TEST(test_steering_trim);
+  RUN_TEST(test_throttle_sweep);
+  RUN_TEST(test_throttle_battery_limits);
+  RUN_TEST(test_throttle_car_esc_reverse);
+  RUN_TEST(test_throttle_brake_button);
+  RUN_TEST(test_throttle_steering_stick);
+  RUN_TEST(test_failsafe_ramp);
+  RUN_TEST(test_connection_lost_time);
+  RUN_TEST(test_mode_connects);
+  RUN_TEST(test_mode_follows_remote);
+  RUN_TEST(test_mode_debug_holds_outputs);
+  RUN_TEST(test_mode_silence_disconnects);
+  RUN_TEST(test_link_idle_rate);
+  RUN_TEST(test_mode_invalid_package);
+  RUN_TEST(test_mode_package_length);
+  RUN_TEST(test_accessories_inputs);
+  RUN_TEST(test_accessories_outputs);
+  RUN_TEST(test_black_box_failsafe);
+  RUN_TEST(test_black_box_idle_rate);
+  return UNITY_END();
+}
+
+// Runs loop() like the Arduino core does, on the virtual clock
+void passLoops(unsigned int count)
+{
+  for (unsigned int i = 0; i < count; i++)
+  {
+    loop();
+    halAdvanceClock(loopMicros);
+  }
+}
+
+// Sends a package like the remote does and runs the vehicle until it has picked it up
+void receive(dataPackage package)
+{
+  package.sequence = ++sequence;
+  TEST_ASSERT_TRUE(remoteRadio.write(&package, sizeof(package)));
+  remoteRadio.flush_rx(); // Drop the telemetry in the acknowledgement
+  passLoops(4);
+}
+
+// A valid package of the remote in easy mode, sticks centered
+dataPackage drivingPackage()
+{
+  dataPackage package;
+  package.rightX = 512;
+  package.leftX = 512;
+  package.rightY = 512;
+  package.leftY = 512;
+  package.mode = easy;
+  package.throttleSensitifity = 40; // Like the easy screen of the remote
+  package.steerSensitifity = 50;
+  return package;
+}
+
+// Pulse width on the steering servo for a position of the steering stick, the rest of rxData stays
+int steeringFor(int leftX)
+{
+  rxData.leftX = leftX;
+  lastReceive = micros(); // No failsafe, the sweeps take a while on the virtual clock
+  updatePwmDevices();
+  return halServoMicros(steeringPin);
+}
+
+// Pulse width the throttle shaper moves the motor output to, for a position of the throttle stick
+int throttleFor(int rightY)
+{
+  rxData.rightY = rightY;
+  lastReceive = micros();
+  updatePwmDevices();
+  return throttleTarget;
+}
+
+void expectValid(const dataPackage &package, bool expected, const char *field, int value)
+{
+  if (validateData(package) == expected)
+    return;
+  char message[64];
+  snprintf(message, sizeof(message), "%s = %i should be %s", field, value, expected ? "valid" : "invalid");
+  TEST_FAIL_MESSAGE(message);
+}
+
+// Adds a value to an FNV-1a digest
+void fold(uint32_t *digest, int value)
+{
+  for (byte i = 0; i < sizeof(value); i++)
+  {
+    *digest ^= (value >> (8 * i)) & 0xFF;
+    *digest *= 16777619u;
+  }
+}
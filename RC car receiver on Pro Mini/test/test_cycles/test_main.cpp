@@ -0,0 +1,294 @@
+/*  Cycle counts of the hot paths of the vehicle on the ATmega328P: the validation of a package, the expo curve, the steering and throttle
+    mapping, the mixer, the throttle shaper and the accessories. Timer 1 counts the CPU clock while a case runs with the interrupts off,
+    so the count is exact and the same on every run. The cost of the measurement itself is taken off.
+    Every case is compared with its entry in baselines[]. A case that takes more than cycleTolerance % longer fails, so does a case without an
+    entry. Each case prints a line in the format of baselines[], paste them over it to take the counts of a faster version as the new baseline.
+    The servos are never attached, Timer 1 is the timer of the Servo library. validateData() prints nothing here, the serial output of a
+    rejected package depends on the baud rate and the fill of the buffer.
+
+    Run with: pio test -e cycles (in the simavr simulator), or pio test -e pro8MHzatmega328 on a Pro Mini
+*/
+
+#include <unity.h>
+#include <Arduino.h> // The headers of the program, so the defines below only reach the program itself
+#include <LibPrintf.h>
+#include <Servo.h>
+#include <EEPROM.h>
+#include <hal.h>
+#include <SPI.h>
+#include <nRF24L01.h>
+#include <RF24.h>
+#include <avr/sleep.h>
+
+#undef printf // LibPrintf maps printf to its own
+#define printf silentPrintf
+int silentPrintf(const char *format, ...)
+{
+  (void)format;
+  return 0;
+}
+#define setup vehicleSetup // setup() and loop() below run the tests
+#define loop vehicleLoop
+#include "../../src/main.cpp"
+#undef printf
+#undef setup
+#undef loop
+
+// Data types
+struct cycleBaseline // Cycles of a case, measured on an earlier version
+{
+  const char *name;
+  unsigned int cycles;
+};
+
+// Prototypes
+void checkCycles(const char *name, void (*run)());
+unsigned int measureCycles(void (*run)());
+dataPackage drivingPackage();
+
+// Global variables
+const byte cycleTolerance = 2; // % a case may take longer than its baseline
+const cycleBaseline baselines[] = { // Pasted from the output of a run in simavr, every case needs an entry
+};
+unsigned int overhead = 0;     // Cycles of an empty case, taken off every measurement
+dataPackage package;           // Input of the validation cases
+volatile bool valid = false;   // Results of the cases, so the compiler keeps the calls
+volatile int expoResult = 0;
+
+void setUp()
+{
+  config = vehicleConfig();
+  buildSteerSchedule();
+  memcpy(mixTable, defaultMix, sizeof(mixTable));
+  compileMixer();
+  rxData = drivingPackage();
+  telemetry.batteryState = 0;
+  escPhase = driving;
+  brakePressed = 0;
+  lastReceive = micros();
+}
+
+void tearDown()
+{
+}
+
+void test_validate_valid()
+{
+  package = drivingPackage();
+  checkCycles("validate ok", [] { valid = validateData(package); });
+  TEST_ASSERT_TRUE(valid);
+}
+
+// Rejected on the first check
+void test_validate_stick()
+{
+  package = drivingPackage();
+  package.rightX = 2000;
+  checkCycles("validate stick", [] { valid = validateData(package); });
+  TEST_ASSERT_FALSE(valid);
+}
+
+// Rejected on the last check, after all the others
+void test_validate_flag()
+{
+  package = drivingPackage();
+  ((byte *)&package.tailLight)[0] = 2; // Neither false nor true
+  checkCycles("validate flag", [] { valid = validateData(package); });
+  TEST_ASSERT_FALSE(valid);
+}
+
+void test_expo()
+{
+  checkCycles("expo 0", [] { expoResult = applyExpo(700, 0); });
+  checkCycles("expo 50", [] { expoResult = applyExpo(700, 50); });
+  checkCycles("expo 100", [] { expoResult = applyExpo(700, 100); });
+}
+
+// Sticks centered in easy mode, the default settings
+void test_pwm_easy()
+{
+  checkCycles("pwm easy", updatePwmDevices);
+}
+
+// Full throttle and full steering in pro mode, with expo on both
+void test_pwm_pro()
+{
+  rxData.mode = pro;
+  rxData.rightY = 1023;
+  rxData.leftX = 0;
+  rxData.throttleSensitifity = 100;
+  rxData.steerSensitifity = 100;
+  config.throttleExpo = 30;
+  config.steerExpo = 20;
+  buildSteerSchedule();
+  checkCycles("pwm pro full", updatePwmDevices);
+}
+
+// Steering schedule between two steps, less range and more expo at speed
+void test_pwm_schedule()
+{
+  rxData.rightY = 900;
+  rxData.leftX = 300;
+  config.steerAtSpeed = 50;
+  config.speedExpo = 40;
+  buildSteerSchedule();
+  checkCycles("pwm schedule", updatePwmDevices);
+}
+
+// Brake button held on a car ESC with ABS, in the middle of the failsafe ramp
+void test_pwm_brake()
+{
+  rxData.brake = true;
+  rxData.rightY = 800;
+  brakePressed = max(millis() - 200, 1UL);
+  config.absRate = 10;
+  lastReceive = micros() - (config.holdTime + 5) * 10000UL;
+  checkCycles("pwm brake", updatePwmDevices);
+}
+
+void test_mixer_default()
+{
+  updateAccessoires();
+  checkCycles("mixer default", runMixer);
+}
+
+// All eight lines in use, with every curve. Only outputs without a servo, Timer 1 stays free
+void test_mixer_curves()
+{
+  const mixLine lines[mixLines] = {
+      {mixSteer, outSteering, 80, 0, 0},
+      {mixRightX, outSteering, 20, 0, 0},
+      {mixThrottle, outMotor, 100, 0, 1},
+      {mixThrottle, outMotor, 50, 0, 2},
+      {mixLeftY, outMotor, -30, 5, 3},
+      {mixHeadLight, outHeadLight, 100, 0, 0},
+      {mixBrake, outTailLight, 100, 0, 0},
+      {mixFull, outTailLight, 50, -20, 0}};
+  memcpy(mixTable, lines, sizeof(mixTable));
+  compileMixer();
+  rxData.rightX = 700;
+  rxData.leftY = 200;
+  updateAccessoires();
+  mixIn[mixSteer] = -300;
+  mixIn[mixThrottle] = 250;
+  checkCycles("mixer curves", runMixer);
+}
+
+// Accelerating with a rate limit, a tick of the shaper is due
+void test_shaper_ramp()
+{
+  config.accelRate = 10;
+  config.softStart = 0;
+  rxData.mode = pro;
+  throttleOutput = throttleMicros(90);
+  throttleTarget = throttleMicros(150);
+  lastShape = micros() - shaperTick * 1000UL;
+  checkCycles("shaper ramp", shapeThrottle);
+}
+
+// Driving off from a standstill during the soft start, the launch ramp begins
+void test_shaper_launch()
+{
+  config.launchTime = 50;
+  rxData.mode = easy;
+  throttleOutput = throttleMicros(90);
+  throttleTarget = throttleMicros(170);
+  launchArmed = true;
+  launching = false;
+  softStartAt = millis() - 500;
+  lastShape = micros() - shaperTick * 1000UL;
+  checkCycles("shaper launch", shapeThrottle);
+}
+
+void test_accessories()
+{
+  rxData.headLight = true;
+  rxData.auxButton1 = true;
+  checkCycles("accessories", updateAccessoires);
+}
+
+// Measures a case and compares it with its baseline, prints the count as a line of baselines[]
+void checkCycles(const char *name, void (*run)())
+{
+  unsigned int cycles = measureCycles(run);
+  char line[64];
+  snprintf(line, sizeof(line), "{\"%s\", %u},", name, cycles);
+  TEST_MESSAGE(line);
+  for (const cycleBaseline &baseline : baselines)
+  {
+    if (strcmp(baseline.name, name) != 0)
+      continue;
+    unsigned long limit = baseline.cycles * (100UL + cycleTolerance) / 100;
+    snprintf(line, sizeof(line), "%s: %u cycles, baseline %u", name, cycles, baseline.cycles);
+    TEST_ASSERT_TRUE_MESSAGE(cycles <= limit, line);
+    return;
+  }
+  snprintf(line, sizeof(line), "%s: no baseline, paste the line above into baselines[]", name);
+  TEST_FAIL_MESSAGE(line);
+}
+
+// Cycles of one run of a case, without the cost of the measurement. The cases stay far below the 65536 cycles of the counter
+unsigned int measureCycles(void (*run)())
+{
+  byte sreg = SREG;
+  cli(); // No millis(), serial or tone() interrupts in the count
+  TCCR1A = 0;
+  TCCR1B = 0;
+  TCNT1 = 0;
+  TIFR1 = _BV(TOV1);
+  TCCR1B = _BV(CS10); // CPU clock, no prescaler
+  run();
+  TCCR1B = 0;
+  unsigned int cycles = TCNT1;
+  bool overflow = TIFR1 & _BV(TOV1);
+  SREG = sreg;
+  TEST_ASSERT_FALSE_MESSAGE(overflow, "the case is too long for the cycle counter");
+  return cycles > overhead ? cycles - overhead : 0;
+}
+
+// A valid package of the remote in easy mode, sticks centered
+dataPackage drivingPackage()
+{
+  dataPackage package;
+  package.rightX = 512;
+  package.leftX = 512;
+  package.rightY = 512;
+  package.leftY = 512;
+  package.mode = easy;
+  package.throttleSensitifity = 50;
+  package.steerSensitifity = 50;
+  return package;
+}
+
+void setup()
+{
+  delay(2000); // A Pro Mini resets when the serial port opens, time for the test runner to connect
+  overhead = 0;
+  overhead = measureCycles([] {});
+
+  UNITY_BEGIN();
+  RUN_TEST(test_validate_valid);
+  RUN_TEST(test_validate_stick);
+  RUN_TEST(test_validate_flag);
+  RUN_TEST(test_expo);
+  RUN_TEST(test_pwm_easy);
+  RUN_TEST(test_pwm_pro);
+  RUN_TEST(test_pwm_schedule);
+  RUN_TEST(test_pwm_brake);
+  RUN_TEST(test_mixer_default);
+  RUN_TEST(test_mixer_curves);
+  RUN_TEST(test_shaper_ramp);
+  RUN_TEST(test_shaper_launch);
+  RUN_TEST(test_accessories);
+  UNITY_END();
+
+  Serial.flush();
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN); // simavr ends the simulation on a sleep with the interrupts off
+  sleep_enable();
+  cli();
+  sleep_cpu();
+}
+
+void loop()
+{
+}
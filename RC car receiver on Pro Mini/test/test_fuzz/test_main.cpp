@@ -0,0 +1,406 @@
+/*  Fuzzing of the path a package takes through the vehicle: the radio, the length check, validateData(), the modes, the mixer and the outputs.
+    An input is a string of frames as they arrive at the radio of the vehicle, see runInput(). Every input starts from a power-on of the
+    vehicle, bound to a remote, or waiting for a binding. After every pass of loop() the servo outputs have to be within the limits of a servo
+    pulse and the pass has to end in time. After the last frame the remote stays silent, the vehicle has to fall back to not connected
+    with the watchdog still kicked.
+    Frames are handed to the radio on the channel it listens on, so the vehicle never loses a frame to a hop it didn't follow.
+
+    Run with: pio test -e native -f test_fuzz
+    The same input format with libFuzzer, from the directory of the program:
+      clang++ -g -O1 -fsanitize=fuzzer,address,undefined -D FUZZ_LIBFUZZER -D HAL_LINUX -D HAL_NO_MAIN -D E2END=1023 -std=gnu++17 \
+        -I ../shared/hal-linux/src -I ../shared/hal/src test/test_fuzz/test_main.cpp <the .cpp files of both src directories> -o fuzz
+      ./fuzz -timeout=5 corpus/
+    Or with AFL, which feeds the input on stdin or as a file argument, also for replaying a crash:
+      afl-clang-fast++ -D FUZZ_STANDALONE ...the rest as above... -o fuzz && afl-fuzz -i seeds -o findings -- ./fuzz @@
+*/
+
+#ifndef FUZZ_LIBFUZZER
+#ifndef FUZZ_STANDALONE
+#include <unity.h>
+#endif
+#endif
+#include <Arduino.h> // The headers of the program, so the define below only reaches the program itself
+#include <LibPrintf.h>
+#include <Servo.h>
+#include <EEPROM.h>
+#include <hal.h>
+#include <SPI.h>
+#include <nRF24L01.h>
+#include <RF24.h>
+#include <hal_linux.h>
+#include <hal_sim_air.h>
+#include <new>
+
+halSimAir air; // Before the program, so it outlives the radio of the program at exit
+
+#define printf silentPrintf // validateData() prints every rejected package, most fuzzed packages are rejected
+int silentPrintf(const char *format, ...)
+{
+  (void)format;
+  return 0;
+}
+#include "../../src/main.cpp"
+#undef printf
+
+// Prototypes
+void startFuzzing();
+void powerOn(bool bindingMode);
+void resetGlobals();
+void runInput(const uint8_t *data, size_t size);
+void passLoop();
+void deliverFrame(const uint8_t *payload, byte length);
+void fuzzCheck(bool condition, const char *message);
+
+// Global variables
+const byte servoPins[] = {3, 5, aux1Pin, aux2Pin}; // Motor controller, steering servo and the aux outputs of the mixer
+const unsigned int loopMicros = 250;                // us one pass of loop() takes on the Pro Mini, besides the clock reads and the radio
+const unsigned long passBudget = 20000;             // us, longest pass of loop(). The easy and pro modes wait 6 ms per pass, the watchdog bites at 500 ms
+const byte gapStep = 5;                             // ms per step of the gap before a frame
+const unsigned long silenceMicros = 3000000;        // us of silence after the last frame, longer than the longest lostTime of 2.5 s
+bindPackage fuzzBinding;                     // Remote the vehicle is bound to at power-on
+uint8_t eepromImage[E2END + 1];              // EEPROM at power-on
+byte pid = 0;                                // Packet id of the frames, tells a new frame apart from a retransmit
+
+// Starts the board of the vehicle once, the EEPROM holds a binding and the stock settings
+void startFuzzing()
+{
+  static bool started = false;
+  if (started)
+    return;
+  started = true;
+  halSelectBoard(halNewBoard()); // Nothing is written to disk
+  halUseVirtualClock();
+  halSetAir(&air); // The radio of the vehicle is alone on the air, the frames are handed to it directly
+  const uint8_t vehicleAddress[5] = {0x17, 0x42, 0xA5, 0x3C, 0xE1};
+  memcpy(fuzzBinding.address, vehicleAddress, sizeof(fuzzBinding.address));
+  fuzzBinding.channel = 76;
+  fuzzBinding.hopBands = 0xFF;
+  EEPROM.put(eepromBinding, fuzzBinding);
+  memcpy(eepromImage, halEepromData(), sizeof(eepromImage));
+}
+
+// Starts the vehicle like after a power cycle: the EEPROM of the first start, the globals and the radio as they come out of a reset
+void powerOn(bool bindingMode)
+{
+  memcpy(halEepromData(), eepromImage, sizeof(eepromImage));
+  halUseVirtualClock(0);
+  resetGlobals();
+  radio.~RF24(); // The radio forgets the frames it holds and the packet id of the last one
+  new (&radio) RF24(7, 8);
+  halSetDigital(bindJumper, bindingMode ? LOW : HIGH);
+  noTone(horn);
+  digitalWrite(receivedLED, LOW);
+  digitalWrite(interferenceLED, LOW);
+  digitalWrite(headLight, LOW); // Toggled by the binding mode
+  digitalWrite(tailLight, LOW);
+  setup();
+  pid = 0;
+}
+
+// Every global of the program back to its initializer
+void resetGlobals()
+{
+  Servo *servos[] = {&motorcontroller, &servo, &auxServo1, &auxServo2};
+  for (Servo *output : servos)
+  {
+    output->detach();
+    *output = Servo();
+  }
+  rawData = dataPackage();
+  rxData = dataPackage();
+  config = vehicleConfig();
+  bound = bindPackage();
+  memset(hopTable, 0, sizeof(hopTable));
+  hopIndex = noHopping;
+  hopMask = 0;
+  hopDeadline = 0;
+  missedHops = 0;
+  memset(hopReceived, 0, sizeof(hopReceived));
+  memset(hopLost, 0, sizeof(hopLost));
+  telemetry = telemetryPackage();
+  raceLink = false;
+  memset(mixTable, 0, sizeof(mixTable));
+  memset(mixIn, 0, sizeof(mixIn));
+  tasksDone = 0;
+  headLightBlink = 0;
+  blinkOn = false;
+  bindRequest = bindPackage();
+  bindConfirmed = false;
+  lastReceive = 0;
+  memset(steerGain, 0, sizeof(steerGain));
+  memset(steerExpoSchedule, 0, sizeof(steerExpoSchedule));
+  lastSequence = 0;
+  framesReceived = 0;
+  framesLost = 0;
+  calmWindows = 0;
+  lastLinkSearch = 0;
+  lastSerial = 0;
+  lastStatusSerial = 0;
+  batteryScale = 13200;
+  batterySum = 0;
+  batterySamples = 0;
+  batteryFiltered = -1;
+  memset(serialLine, 0, sizeof(serialLine));
+  serialLength = 0;
+  throttleTarget = throttleMicros(90);
+  throttleOutput = throttleMicros(90);
+  lastShape = 0;
+  softStartAt = 0;
+  lastMoving = 0;
+  launchAt = 0;
+  launching = false;
+  launchArmed = false;
+  brakePressed = 0;
+  escPhase = driving;
+  phaseStart = 0;
+  memset(mixOps, 0, sizeof(mixOps));
+  mixOpCount = 0;
+  mixDriven = 0;
+  invalidSeen = false;
+  memset(boxRing, 0, sizeof(boxRing)); // Not kept over a power cycle
+  boxNext = 0;
+  boxCount = 0;
+  boxCheck = 0;
+  lastBoxSample = 0;
+  boxEvent = 0;
+  boxWait = 0;
+  boxWritten = -1;
+  boxUptime = 0;
+  boxSlot = 0;
+  boxNumber = 0;
+  lastFailsafeRecord = 0;
+  boxFailsafe = false;
+  boxCutoff = false;
+  boxDumpLine = -1;
+}
+
+// Runs one input. The first byte picks the start: bit 0 set = waiting for a binding. Then follow the frames, each a header byte and the payload:
+// header % 33 is the length of the payload, header / 33 is the gap before the frame in steps of 5 ms. The last payload may be cut short
+void runInput(const uint8_t *data, size_t size)
+{
+  startFuzzing();
+  powerOn(size > 0 && (data[0] & 1));
+  size_t position = 1;
+  while (position < size)
+  {
+    byte header = data[position++];
+    byte length = header % 33;
+    unsigned long long gapEnd = halClockMicros() + (header / 33) * gapStep * 1000ULL;
+    while (halClockMicros() < gapEnd)
+      passLoop();
+    length = min((size_t)length, size - position);
+    deliverFrame(data + position, length);
+    position += length;
+    passLoop();
+    passLoop();
+  }
+  unsigned long long silenceEnd = halClockMicros() + silenceMicros;
+  while (halClockMicros() < silenceEnd)
+    passLoop();
+  fuzzCheck(rxData.mode == notConnected || rxData.mode == binding, "the vehicle doesn't notice that the remote went silent");
+}
+
+// One pass of loop(), then the checks that hold after every pass
+void passLoop()
+{
+  unsigned long long start = halClockMicros();
+  loop();
+  fuzzCheck(halClockMicros() - start <= passBudget, "a pass of loop() takes too long");
+  halAdvanceClock(loopMicros);
+  fuzzCheck(!halWatchdogExpired(), "the watchdog expired");
+  fuzzCheck(rxData.mode >= idle && rxData.mode <= binding, "rxData.mode is not a mode");
+  fuzzCheck(throttleTarget >= MIN_PULSE_WIDTH && throttleTarget <= MAX_PULSE_WIDTH, "throttleTarget is not a servo pulse");
+  fuzzCheck(throttleOutput >= MIN_PULSE_WIDTH && throttleOutput <= MAX_PULSE_WIDTH, "throttleOutput is not a servo pulse");
+  for (byte pin : servoPins)
+  {
+    int pulse = halServoMicros(pin);
+    fuzzCheck(pulse == 0 || (pulse >= MIN_PULSE_WIDTH && pulse <= MAX_PULSE_WIDTH), "a servo output is out of range");
+  }
+}
+
+// Hands a frame to the radio of the vehicle, from the remote it listens to: on its channel and data rate, to the address of pipe 1
+void deliverFrame(const uint8_t *payload, byte length)
+{
+  const uint8_t *pipeAddress = rxData.mode == binding ? (const uint8_t *)&address[0] : bound.address; // address[0] is stored LSB first
+  halFrame frame;
+  memset(&frame, 0, sizeof(frame));
+  for (int i = 4; i >= 0; i--)
+    frame.address = frame.address << 8 | pipeAddress[i];
+  frame.channel = radio.getChannel();
+  frame.dataRate = radio.getDataRate();
+  frame.paLevel = RF24_PA_MAX;
+  frame.pid = pid;
+  frame.noAck = raceLink;
+  frame.length = length;
+  memcpy(frame.payload, payload, length);
+  pid = (pid + 1) % 4;
+  halFrame ack;
+  radio.deliver(frame, &ack); // The acknowledgement and the telemetry in it go nowhere
+}
+
+#if defined(FUZZ_LIBFUZZER) || defined(FUZZ_STANDALONE)
+void fuzzCheck(bool condition, const char *message)
+{
+  if (condition)
+    return;
+  fprintf(stderr, "Fuzzing: %s at %.3f ms\n", message, halClockMicros() / 1e3);
+  abort();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  runInput(data, size);
+  return 0;
+}
+#endif
+
+#ifdef FUZZ_STANDALONE
+// Runs the files named on the command line, or stdin
+int main(int argc, char **argv)
+{
+  for (int i = argc > 1 ? 1 : 0; i < argc; i++)
+  {
+    FILE *file = i > 0 ? fopen(argv[i], "rb") : stdin;
+    if (file == nullptr)
+    {
+      perror(argv[i]);
+      return 1;
+    }
+    uint8_t data[4096];
+    size_t size = fread(data, 1, sizeof(data), file);
+    if (file != stdin)
+      fclose(file);
+    runInput(data, size);
+  }
+  return 0;
+}
+#endif
+
+#if !defined(FUZZ_LIBFUZZER) && !defined(FUZZ_STANDALONE)
+// Prototypes
+dataPackage validPackage();
+void appendFrame(uint8_t *data, size_t *size, byte gap, const void *payload, byte length);
+uint32_t nextRandom();
+
+// Global variables
+const unsigned int corpusSize = 400; // Generated inputs, a few seconds of running
+uint32_t randomState = 0x2545F491;   // xorshift32, the same inputs on every run
+
+void fuzzCheck(bool condition, const char *message)
+{
+  TEST_ASSERT_TRUE_MESSAGE(condition, message);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+// A valid package of every length, and random bytes of every length. Only the 30 bytes of a dataPackage connect the vehicle
+void test_fuzz_lengths()
+{
+  dataPackage package = validPackage();
+  for (byte length = 0; length <= 32; length++)
+  {
+    uint8_t payload[32] = {0};
+    memcpy(payload, &package, min((size_t)length, sizeof(package)));
+    uint8_t data[64];
+    size_t size = 1;
+    data[0] = 0;
+    appendFrame(data, &size, 0, payload, length);
+    runInput(data, size);
+    for (byte i = 0; i < length; i++)
+      payload[i] = nextRandom();
+    size = 1;
+    appendFrame(data, &size, 0, payload, length);
+    runInput(data, size);
+  }
+}
+
+// Valid packages in every mode of the remote, some with a few bytes or bits changed
+void test_fuzz_mutated_packages()
+{
+  for (unsigned int n = 0; n < corpusSize; n++)
+  {
+    uint8_t data[512];
+    size_t size = 1;
+    data[0] = 0;
+    byte frames = 1 + nextRandom() % 12;
+    for (byte i = 0; i < frames; i++)
+    {
+      dataPackage package = validPackage();
+      package.mode = nextRandom() % 4; // Idle, easy, pro or debug
+      package.sequence = i;
+      uint8_t *bytes = (uint8_t *)&package;
+      byte changes = nextRandom() % 4;
+      for (byte j = 0; j < changes; j++)
+      {
+        byte at = nextRandom() % sizeof(package);
+        if (nextRandom() % 2)
+          bytes[at] ^= 1 << nextRandom() % 8;
+        else
+          bytes[at] = nextRandom();
+      }
+      appendFrame(data, &size, nextRandom() % 3, &package, sizeof(package));
+    }
+    runInput(data, size);
+  }
+}
+
+// Random frames of random lengths, with the vehicle bound or waiting for a binding
+void test_fuzz_random_frames()
+{
+  for (unsigned int n = 0; n < corpusSize; n++)
+  {
+    uint8_t data[512];
+    size_t size = 1 + nextRandom() % sizeof(data);
+    for (size_t i = 0; i < size; i++)
+      data[i] = nextRandom();
+    runInput(data, size);
+  }
+}
+
+// A valid package of the remote in easy mode, sticks centered
+dataPackage validPackage()
+{
+  dataPackage package;
+  package.rightX = 512;
+  package.leftX = 512;
+  package.rightY = 512;
+  package.leftY = 512;
+  package.mode = easy;
+  package.throttleSensitifity = 40;
+  package.steerSensitifity = 50;
+  return package;
+}
+
+// Adds a frame to an input, gap in steps of 5 ms
+void appendFrame(uint8_t *data, size_t *size, byte gap, const void *payload, byte length)
+{
+  data[(*size)++] = gap * 33 + length;
+  memcpy(data + *size, payload, length);
+  *size += length;
+}
+
+uint32_t nextRandom()
+{
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_fuzz_lengths);
+  RUN_TEST(test_fuzz_mutated_packages);
+  RUN_TEST(test_fuzz_random_frames);
+  return UNITY_END();
+}
+#endif
@@ -5,7 +5,6 @@
 
     To-Do:
     -Adding interrupts for button presses, waiting for Teensy LC
-    -2 way communication for battery voltage monitoring of the vehicle
 */
 
 #include <Arduino.h>
@@ -13,7 +12,8 @@
 #include <EEPROM.h>
 
 // OLED Display related
-#include <U8g2lib.h> // https://github.com/olikraus/U8g2_Arduino
+#include <U8g2lib.h>     // https://github.com/olikraus/U8g2_Arduino
+#include <hal_display.h> // The SH1106 of the remote, or the emulated one of the Linux backend
 // OLED on Teensy:    A4(SDA), A5(SCL)
 // I2C address OLED = 0x3C
 
@@ -77,14 +77,89 @@ struct dataPackage // Max size of this struct is 32 bytes, that's NRF24L01 buffe
   bool honk = false;                // 0 = off, 1 = on
   bool headLight = false;           // 0 = off, 1 = on
   bool tailLight = false;           // 0 = off, 1 = on
+  uint8_t configIndex = 0;          // Index of the vehicleConfig byte carried by this package
+  uint8_t configValue = 0;          // Value of the vehicleConfig byte carried by this package
+  uint8_t hopIndex = 0xFF;          // 0...15, slot of the hop sequence this package is sent on, 0xFF = not hopping
+  uint16_t hopMask = 0;             // Slots of the hop sequence that are skipped because of interference
+  uint8_t sequence = 0;             // Counts up every package, used by the vehicle to count lost packages
+  uint8_t retryAverage = 0;         // Average retransmits per package of the remote times 16, used by the vehicle to adjust its power
+  uint8_t copies = 0;               // 0 = ARQ link, 1...4 = race link with this many copies of every package, the vehicle switches along
+  uint8_t copy = 0;                 // 0...copies - 1, number of this copy in the race link
+} __attribute__((packed));
+
+struct telemetryPackage // Status of the vehicle, sent back with the acknowledgement of a package. Must be consistent with the receiver
+{
+  uint8_t lostFrames = 0;      // 0...100 %, share of the packages of the remote that didn't arrive
+  uint8_t paLevel = 0;         // Power level of the vehicle, RF24_PA_MIN...RF24_PA_MAX
+  uint8_t firstCopy = 0;       // Average number of the first copy that arrived in the race link times 16
+  uint8_t watchdogResets = 0;  // Resets of the vehicle by the watchdog, stored in the EEPROM of the vehicle
+  uint8_t brownoutResets = 0;  // Resets of the vehicle by a low supply voltage, stored in the EEPROM of the vehicle
+  uint8_t externalResets = 0;  // Resets of the vehicle by the reset pin, stored in the EEPROM of the vehicle
+  uint16_t batteryVoltage = 0; // mV, filtered voltage of the battery of the vehicle
+  uint8_t batteryState = 0;    // 0 = ok, 1 = cutback, throttle is halved, 2 = cutoff, motor is stopped
+} __attribute__((packed));          // Packed, so the layout is the same on the Teensy LC and the Pro Mini
+
+struct vehicleConfig // Settings of the vehicle, streamed to the vehicle one byte per package. Must be consistent with the receiver
+{
+  int8_t throttleTrim = 0;       // -30...30 degrees
+  int8_t steerTrim = 0;          // -30...30 degrees
+  uint8_t throttleExpo = 0;      // 0...100 %
+  uint8_t steerExpo = 0;         // 0...100 %
+  uint8_t failsafeThrottle = 90; // 0...180 degrees, throttle position when the connection is lost
+  uint8_t failsafeSteer = 90;    // 0...180 degrees, steering position when the connection is lost
+  uint8_t holdTime = 10;         // x10 ms without packages the last command is held
+  uint8_t cutTime = 25;          // x10 ms without packages after which the throttle has ramped to the failsafe position
+  uint8_t lostTime = 100;        // x10 ms without packages after which the vehicle counts as not connected
+  uint8_t batteryType = 0;       // 0 = not monitored, 1 = LiPo, 2 = LiFe, 3 = NiMH
+  uint8_t batteryCells = 2;      // 1...8 cells in series
+  uint8_t steerAtSpeed = 100;    // 30...100 %, steering range left at full throttle
+  uint8_t speedExpo = 0;         // 0...100 %, steering expo added at full throttle
+  uint8_t accelRate = 0;         // us per ms the throttle may move away from neutral, 0 = not limited. Halved in easy mode
+  uint8_t decelRate = 0;         // us per ms the throttle may move towards neutral, 0 = not limited. Halved in easy mode
+  uint8_t softStart = 100;       // x10 ms to open up the throttle after a failsafe or a reconnect, 0 = off
+  uint8_t launchTime = 0;        // x10 ms of the launch ramp when driving off from a standstill, 0 = off
+  uint8_t escType = 0;           // 0 = car ESC (brake, then reverse after neutral), 1 = crawler ESC (direct reverse), 2 = no reverse
+  uint8_t absRate = 0;           // 0...20 Hz, the brake is released half of every period, 0 = off
+};
+
+struct mixLine // One line of the channel mixer: output += weight * curve(input) + offset. Must be consistent with the receiver
+{
+  uint8_t source; // Mixer input, 0xFF = unused line
+  uint8_t output; // Mixer output
+  int8_t weight;  // -100...100 %
+  int8_t offset;  // -100...100 % of the full travel
+  uint8_t curve;  // 0 = linear, 1 = positive side only, 2 = negative side only, 3 = absolute value
+};
+
+struct modelProfile // All settings of one vehicle, a copy of every profile is stored in the EEPROM
+{
+  uint8_t address[5] = {0xF7, 0xA5, 0x7C, 0x0F, 0xA4}; // RF address of the vehicle, LSB first
+  uint8_t channel = 76;                                // 0...125, NRF24L01 channel of the vehicle
+  uint8_t throttleSensitifity = 40;                    // 5...100 %
+  uint8_t steerSensitifity = 50;                       // 5...100 %
+  uint8_t hopping = 0;                                 // 0 = stay on channel, 1 = frequency hopping
+  uint8_t hopBands = 0xFF;                             // Bands of the hop range the hop sequence may use, bit 0 = lowest band
+  uint8_t raceCopies = 0;                              // 0 = ARQ link with retransmits, 1...4 = race link, copies sent of every package
+  uint8_t mixerPreset = 0;                             // 0 = normal, 1 = four wheel steering, 2 = tank steering. Sent to the vehicle as a mixer table
+  vehicleConfig vehicle;                               // Settings that are sent to the vehicle
+};
+
+struct bindPackage // Sent on the bind channel to pair a vehicle with a model profile. Must be consistent with the receiver
+{
+  uint8_t magic[3] = {'B', 'N', 'D'}; // Tells a bind package apart from noise
+  uint8_t address[5];                 // New RF address of the vehicle, LSB first
+  uint8_t channel;                    // NRF24L01 channel the vehicle uses after binding
+  uint8_t hopBands;                   // Bands of the hop range the hop sequence may use, found by the channel survey
 };
 
 // Objects
-U8G2_SH1106_128X64_NONAME_1_HW_I2C oled(U8G2_R0, U8X8_PIN_NONE); // 128x64 1.3 inch OLED, I2C, Uno, Nano, Mini Pro don't have enough RAM so use page_buffer
+halDisplay oled(U8G2_R0, U8X8_PIN_NONE);                         // 128x64 1.3 inch OLED, I2C, Uno, Nano, Mini Pro don't have enough RAM so use page_buffer
 RF24 radio(9, 10);                                               // Divining CE and CSN pins
+const byte radioCE = 9;                                          // CE pin of the radio, toggled directly for fast channel changes while listening
 
 // Prototypes
 void sendData(const byte mode);
+unsigned int sendInterval(byte mode);
 void drawStartupScreen();
 void drawMenu(byte *state);
 void drawEasyScreen(byte *state);
@@ -98,27 +173,111 @@ void drawBasicInfo();
 void drawEditProSettings();
 void drawValueSet();
 int readJoystick(byte joystick);
+void drawModelScreen(byte *state);
+bool drawList(const char *header, const char *const items[], byte count, byte *cursor);
+void loadProfiles();
+int profileAddress(byte index);
+void applyProfile(byte index);
+void saveProfile();
+void drawBindScreen(byte *state);
+void generateAddress(uint8_t *newAddress);
+bool nextPage();
+void buildHopTable(const uint8_t *hopAddress, byte baseChannel, byte bands, byte *table);
+byte hopBand(byte channel);
+void surveyChannels();
+void drawSurvey();
+void tuneReceiver(byte channel);
+bool drawSpectrum();
+void sendWhileListening(byte mode);
+byte nextHopSlot(byte slot, uint16_t mask);
+void hop(bool delivered);
+void adaptPower(bool delivered);
+void setLink(byte copies);
+void switchLink(bool delivered);
+void drawLinkTest(byte *state);
+void testLink(byte copies, byte *loss, unsigned int *latency);
+void updateRemoteBattery();
+void flashSendLED(bool on);
+void printVoltage(unsigned int millivolts);
+byte configByte(byte index);
 
 // Global variables
-const uint64_t address[2] = {0xA40F7CA5F7LL, 0x32FA46D0E2LL}; // First address for communication to the vehicle, second address for communication to the remote. Second address unused for now.
+const uint64_t address[2] = {0xA40F7CA5F7LL, 0x32FA46D0E2LL}; // First address is used on the bind channel to pair a vehicle with a profile, second address unused for now.
+const byte bindChannel = 80;                                  // Well-known channel for binding, the vehicles get their own address and channel from the remote
+const byte framePeriod = 10;                                  // ms between packages while driving or hopping. Must be consistent with the receiver
+const byte arqRetryDelay = 5;                                 // Retransmit delay of the ARQ link in steps of 250 us, the default of the RF24 library
+const byte arqRetryCount = 15;                                // Retransmits of the ARQ link, the default of the RF24 library
+const byte hopRetryDelay = 1;                                 // While hopping a write with all its retransmits has to fit in a frame, about 4 ms. Must be consistent with the lateness of the receiver
+const byte hopRetryCount = 3;                                 // Retransmits while hopping
+const byte hopCount = 16;                                     // Number of channels in the hop sequence
+const byte hopLowest = 2;                                     // Lowest channel the hop sequence uses
+const byte hopHighest = 79;                                   // Highest channel the hop sequence uses, stays below the bind channel
+const byte noHopping = 0xFF;                                  // hopIndex of packages that are not hopping
+const byte hopBandCount = 8;                                  // The hop range is split in bands, the channel survey chooses which ones the sequence uses
+const byte channelCount = 126;                                // Channels of the NRF24L01
 const uint8_t *textFont = u8g2_font_6x13_tf;
 const uint8_t *headerFont = u8g2_font_helvB10_te;
 const byte idle = 0; // Statemachine states
 const byte easy = 1;
 const byte pro = 2;
 const byte debug = 3;
+const byte models = 4;
+const byte binding = 5;
+const byte linkTest = 6;
+const byte mixLines = 8;            // Lines of the mixer table
+const byte mixerConfigIndex = 64;   // configIndex of the first byte of the mixer table, the vehicleConfig bytes come before it
+const byte mixSteer = 0;            // Mixer inputs, all scaled to -512...511
+const byte mixThrottle = 1;
+const byte mixRightX = 2;
+const byte mixLeftX = 3;
+const byte mixRightY = 4;
+const byte mixLeftY = 5;
+const byte mixAux1 = 6;
+const byte mixAux2 = 7;
+const byte mixHeadLight = 8;
+const byte mixTailLight = 9;
+const byte mixHonk = 10;
+const byte mixBrake = 11;
+const byte mixBatteryLow = 12;
+const byte mixFull = 13;
+const byte mixInputs = 14;
+const byte outSteering = 0;         // Mixer outputs
+const byte outMotor = 1;
+const byte outAux1 = 2;
+const byte outAux2 = 3;
+const byte outHeadLight = 4;
+const byte outTailLight = 5;
+const byte outHorn = 6;
+const byte mixOutputs = 7;
 const int joyStickLowTrigger = 400;  // Joystick trigger value on low side
 const int joyStickHighTrigger = 600; // Joystick trigger value on high side
 dataPackage txData;                  // Data to be sent to the vehicle
+modelProfile profile;                // Settings of the vehicle that is controlled right now
+byte activeProfile = 0;              // Index of the profile that is controlled right now
+byte occupancy[channelCount];        // Number of samples per channel with a signal stronger than -64 dBm
+byte surveyChannel = 76;             // Quietest channel of the survey of the bind screen
+byte surveyBands = 0xFF;             // Quietest bands of the hop range
+telemetryPackage telemetry;          // Last status received from the vehicle
+byte paLevel = RF24_PA_MIN;          // Power level of the radio, starts low to save the battery
+unsigned int retryAverage = 0;       // Average retransmits per package times 16, a lost package counts as 16 retransmits
+byte linkCopies = 0;                 // Copies per package of the link the radio is set to, 0 = ARQ link with retransmits
+unsigned int remoteVoltage = 0;      // mV, filtered voltage of the battery of the remote
+byte remotePercent = 0;              // 0...100 %, charge of the battery of the remote
+bool remoteLow = false;              // Battery of the remote is almost empty, shown with a banner and the send LED
+bool lowBanner = false;              // The frame that is drawn shows the low battery banner, the same on all its pages
 
 void setup()
 {
   radio.begin(); // Start NRF24L01
-  radio.openWritingPipe(address[0]);
   radio.setPALevel(RF24_PA_MIN);
+  radio.enableDynamicPayloads(); // Needed for the confirmation of the vehicle while binding
+  radio.enableAckPayload();
   radio.stopListening();
+  loadProfiles();              // Read all model profiles from the EEPROM
+  applyProfile(activeProfile); // Point the radio to the vehicle of the last used profile
 
-  oled.begin(); // Start OLED
+  oled.begin();             // Start OLED
+  oled.setBusClock(400000); // Fast mode I2C, a frame takes about a quarter of the time at 100 kHz
 
   Serial.begin(9600); // For debugging purposes
 
@@ -135,7 +294,7 @@ void setup()
   // Indicators
   pinMode(sendLED, OUTPUT);
 
-  drawStartupScreen();
+  drawStartupScreen(); // The channel survey waits for the bind screen, the vehicle gets its packages right after the start
 }
 
 byte state = idle; // Start value of the statemachine
@@ -155,24 +314,97 @@ void loop()
   case debug:
     drawDebugScreen(&state);
     break;
+  case models:
+    drawModelScreen(&state);
+    break;
+  case binding:
+    drawBindScreen(&state);
+    break;
+  case linkTest:
+    drawLinkTest(&state);
+    break;
   }
 }
 
 unsigned long previousSend = 0; // Used to limit the send rate
+byte sendMode = idle;           // Mode of the last sendData call, used to keep sending while the display is being drawn
+byte hopTable[hopCount];        // Channels of the hop sequence of the active profile
+byte hopIndex = 0;              // Slot of the hop sequence of the last package
+uint16_t hopMask = 0;           // Slots that are skipped because of interference, slot 0 is never skipped
+byte hopSent[hopCount];         // Packages sent per slot since the last evaluation
+byte hopFailed[hopCount];       // Packages per slot that were not acknowledged by the vehicle
+byte configIndex = 0;           // Next byte of the vehicle configuration that will be sent, the mixer table follows the vehicleConfig bytes
+byte configBurst = 0;           // Packages left that are sent at the frame rate, to get a changed configuration to the vehicle quickly
+byte copiesLeft = 0;            // Copies of the last package that still have to be sent in the race link
+unsigned long copyTime = 0;     // micros() of the last copy
+bool lastDelivered = false;     // The last package was acknowledged, or sent in the race link. Used by the link test
+unsigned int writeTime = 0;     // us the last package took to send, including the retransmits of the ARQ link
+bool hopRetries = false;        // The radio is set to the short retransmits of the hopping
+byte telemetryCount = 0;        // Status packages received from the vehicle, the link test waits for a new one
+const byte mixerPresetCount = 3;
+const mixLine mixerPresets[mixerPresetCount][mixLines] = { // Mixer tables of the presets, the vehicle runs the table it receives
+    {// Normal: steering and throttle straight through, brake light on the tail light
+     {mixSteer, outSteering, 100, 0, 0},
+     {mixThrottle, outMotor, 100, 0, 0},
+     {mixHeadLight, outHeadLight, 100, 0, 0},
+     {mixTailLight, outTailLight, 100, 0, 0},
+     {mixBrake, outTailLight, 100, 0, 0},
+     {mixHonk, outHorn, 100, 0, 0},
+     {0xFF, 0, 0, 0, 0},
+     {0xFF, 0, 0, 0, 0}},
+    {// Four wheel steering: the rear steering servo on the first extra output turns the other way
+     {mixSteer, outSteering, 100, 0, 0},
+     {mixSteer, outAux1, -100, 0, 0},
+     {mixThrottle, outMotor, 100, 0, 0},
+     {mixHeadLight, outHeadLight, 100, 0, 0},
+     {mixTailLight, outTailLight, 100, 0, 0},
+     {mixBrake, outTailLight, 100, 0, 0},
+     {mixHonk, outHorn, 100, 0, 0},
+     {0xFF, 0, 0, 0, 0}},
+    {// Tank steering: left motor controller on the motor output, right motor controller on the first extra output
+     {mixThrottle, outMotor, 100, 0, 0},
+     {mixSteer, outMotor, 100, 0, 0},
+     {mixThrottle, outAux1, 100, 0, 0},
+     {mixSteer, outAux1, -100, 0, 0},
+     {mixHeadLight, outHeadLight, 100, 0, 0},
+     {mixTailLight, outTailLight, 100, 0, 0},
+     {mixBrake, outTailLight, 100, 0, 0},
+     {mixHonk, outHorn, 100, 0, 0}}};
+const byte configLength = sizeof(vehicleConfig) + sizeof(mixerPresets[0]); // Bytes of one round of the vehicle configuration
+static_assert(sizeof(vehicleConfig) <= mixerConfigIndex, "vehicleConfig runs into the mixer table");
+
+// Byte of the vehicle configuration, the vehicleConfig of the profile followed by the mixer table of its preset
+byte configByte(byte index)
+{
+  if (index < sizeof(vehicleConfig))
+    return ((const byte *)&profile.vehicle)[index];
+  byte preset = profile.mixerPreset < mixerPresetCount ? profile.mixerPreset : 0;
+  return ((const byte *)mixerPresets[preset])[index - sizeof(vehicleConfig)];
+}
 
 // Gather all current statuses of all input devices and sends it to the RC car
 void sendData(const byte mode)
 {
-  unsigned int sendDelay;
+  unsigned int sendDelay = sendInterval(mode);
 
-  if (mode == idle || mode == debug) // Send data slower in idle and debug mode
-    sendDelay = 2000;
-  else
-    sendDelay = 0;
+  sendMode = mode;
+  updateRemoteBattery();
+  if (copiesLeft > 0 && micros() - copyTime >= framePeriod * 1000UL / linkCopies) // Spread the copies of the race link over the frame
+  {
+    copyTime += framePeriod * 1000UL / linkCopies;
+    copiesLeft--;
+    txData.copy++;
+    radio.write(&txData, sizeof(dataPackage));
+  }
   if (millis() - previousSend >= sendDelay)
   {
-    previousSend = millis();
-    digitalWrite(sendLED, HIGH);
+    if (millis() - previousSend < 2 * sendDelay) // Keep the frame rate steady, unless a frame was skipped
+      previousSend += sendDelay;
+    else
+      previousSend = millis();
+    if (configBurst > 0)
+      configBurst--;
+    flashSendLED(HIGH);
     txData.rightX = analogRead(rightX);
     txData.rightY = analogRead(rightY);
     txData.leftX = analogRead(leftX);
@@ -183,12 +415,66 @@ void sendData(const byte mode)
     txData.backButton = !digitalRead(backButton);                   // Invert the value because the button is pulled up
     txData.auxButton1 = !digitalRead(auxButton1);                   // Invert the value because the button is pulled up
     txData.auxButton2 = !digitalRead(auxButton2);                   // Invert the value because the button is pulled up
-    radio.write(&txData, sizeof(dataPackage));                      // Send data via NRF24L01
-    digitalWrite(sendLED, LOW);
+    txData.configIndex = configIndex < sizeof(vehicleConfig) ? configIndex : mixerConfigIndex + configIndex - sizeof(vehicleConfig); // Every package carries one byte of the vehicle configuration
+    txData.configValue = configByte(configIndex);
+    configIndex = (configIndex + 1) % configLength;
+    if (hopRetries != (profile.hopping != 0)) // The long retransmits of the default would block past the next frame and the vehicle would hop away
+    {
+      hopRetries = profile.hopping;
+      radio.setRetries(hopRetries ? hopRetryDelay : arqRetryDelay, hopRetries ? hopRetryCount : arqRetryCount);
+    }
+    if (profile.hopping) // Move to the next channel of the hop sequence before sending
+    {
+      hopIndex = nextHopSlot(hopIndex, hopMask);
+      radio.setChannel(hopTable[hopIndex]);
+      txData.hopIndex = hopIndex;
+      txData.hopMask = hopMask;
+    }
+    else
+      txData.hopIndex = noHopping;
+    txData.sequence++;
+    txData.copies = profile.raceCopies; // Asks the vehicle to switch over when the link of the profile changes
+    txData.copy = 0;
+    unsigned long writeStart = micros();
+    bool delivered = radio.write(&txData, sizeof(dataPackage)); // Send data via NRF24L01
+    writeTime = micros() - writeStart;
+    lastDelivered = delivered;
+    if (linkCopies == 0) // Only the ARQ link gets acknowledgements, so only there is feedback for the power and the hopping
+    {
+      if (delivered && radio.available()) // The vehicle sends its status with the acknowledgement
+      {
+        if (radio.getDynamicPayloadSize() == sizeof(telemetryPackage))
+        {
+          radio.read(&telemetry, sizeof(telemetryPackage));
+          telemetryCount++;
+        }
+        else
+          radio.flush_rx();
+      }
+      adaptPower(delivered);
+      if (profile.hopping)
+        hop(delivered);
+    }
+    if (linkCopies != profile.raceCopies)
+      switchLink(delivered);
+    else if (linkCopies > 0) // The copies follow during the frame
+    {
+      copiesLeft = linkCopies - 1;
+      copyTime = writeStart;
+    }
+    flashSendLED(LOW);
     // debugSerial(); // For debugging purposes
   }
 }
 
+// Returns the ms between two packages in a mode
+unsigned int sendInterval(byte mode)
+{
+  if ((mode == idle || mode == debug) && profile.hopping == false && configBurst == 0) // Send data slower in idle and debug mode, unless the vehicle has to follow the hops or receive new settings
+    return constrain(profile.vehicle.lostTime * 10 / 3, framePeriod, 2000); // A few packages within the lost time of the failsafe, so a lost package doesn't disconnect the vehicle
+  return framePeriod; // Fixed frame rate, the hop timing of the vehicle depends on it
+}
+
 // Draws a little startup annimation on the screen
 void drawStartupScreen()
 {
@@ -211,51 +497,52 @@ void drawStartupScreen()
   }
 }
 
-byte menuOffset = 0; // Offset for the cursor position in the idle
+byte menuIndex = 0; // Position of the cursor in the menu
 // Prompts user with all control options of the vehicle. Returns selected mode by the user when choice is made
 void drawMenu(byte *state)
 {
   txData.mode = idle;
+  const char *const items[] = {"Easy", "Pro", "Debug", "Model", "Bind", "Link test"};
+  const byte choices[] = {easy, pro, debug, models, binding, linkTest};
+
+  while (drawList("Menu", items, sizeof(items) / sizeof(items[0]), &menuIndex) == false) // Loop until user has made a choice of control mode
+    ;
+  *state = choices[menuIndex];
+}
+
+// Draws a scrolling list below a header. Returns true when the user chooses the item under the cursor, false when the user goes back
+bool drawList(const char *header, const char *const items[], byte count, byte *cursor)
+{
   const byte yDistance = 15; // Y-distance between objects (header object excluded)
   const byte xDistance = 10; // X-distance between objects
+  const byte rows = 3;       // Number of items that fit below the header
 
-  while (true) // Loop until user has made a choice of control mode
+  while (true) // Loop until user has made a choice
   {
-    sendData(idle);   // Send data to the RC car
-    oled.firstPage(); // Start drawing process
+    sendData(idle);                                          // Send data to the RC car
+    byte top = (*cursor < rows) ? 0 : *cursor - rows + 1; // First visible item, the list scrolls along with the cursor
+    oled.firstPage();                                        // Start drawing process
     do
     {
-      drawHeader("Menu");
+      drawHeader(header);
       oled.setFont(textFont);
-      oled.drawStr(0, (yDistance * 2 + menuOffset), ">");
-      oled.drawStr(xDistance, yDistance * 2, "Easy");
-      oled.drawStr(xDistance, yDistance * 3, "Pro");
-      oled.drawStr(xDistance, yDistance * 4, "Debug");
-
-    } while (oled.nextPage()); // While still drawing
+      oled.drawStr(0, yDistance * (*cursor - top + 2), ">");
+      for (byte row = 0; row < rows && top + row < count; row++)
+        oled.drawStr(xDistance, yDistance * (row + 2), items[top + row]);
+    } while (nextPage()); // While still drawing
 
     // Check for user joystick input
     int joystickValue = readJoystick(rightY);
-    if (joystickValue > joyStickHighTrigger && menuOffset < 2 * yDistance)
-    {
-      menuOffset += yDistance;
-    }
-    else if (joystickValue < joyStickLowTrigger && menuOffset > 1)
-    {
-      menuOffset -= yDistance;
-    }
+    if (joystickValue > joyStickHighTrigger && *cursor < count - 1)
+      (*cursor)++;
+    else if (joystickValue < joyStickLowTrigger && *cursor > 0)
+      (*cursor)--;
 
-    // Check for user mode choice
+    // Check for user choice
     if (risingEdge(ackButton))
-    {
-      if (menuOffset == 0)
-        *state = easy;
-      else if (menuOffset == yDistance)
-        *state = pro;
-      else
-        *state = debug;
-      return;
-    }
+      return true;
+    if (risingEdge(backButton))
+      return false;
   }
 }
 
@@ -275,7 +562,7 @@ void drawEasyScreen(byte *state)
     {
       drawHeader("Easy");
       drawBasicInfo();         // Draws all basic information needed for the user
-    } while (oled.nextPage()); // While still drawing
+    } while (nextPage()); // While still drawing
   }
   *state = idle; // Return to idle mode
 }
@@ -284,8 +571,8 @@ void drawEasyScreen(byte *state)
 void drawProScreen(byte *state)
 {
   txData.mode = pro;
-  txData.throttleSensitifity = EEPROM.read(0);        // Read throttle sensitivity from EEPROM
-  txData.steerSensitifity = EEPROM.read(1);           // Read steering sensitivity from EEPROM
+  txData.throttleSensitifity = profile.throttleSensitifity; // Sensitivities of the active model profile
+  txData.steerSensitifity = profile.steerSensitifity;
   const byte yDistance = oled.getDisplayHeight() / 4; // Y-distance between objects (header object excluded)
   const byte xDistance = oled.getDisplayWidth() / 2;  // X-distance between objects
 
@@ -306,7 +593,7 @@ void drawProScreen(byte *state)
       oled.print("ST: ");
       oled.print(txData.steerSensitifity);
       oled.print("%");
-    } while (oled.nextPage()); // While still drawing
+    } while (nextPage()); // While still drawing
 
     if (risingEdge(ackButton)) // If user presses the acknowledge button, enter edit mode
       drawEditProSettings();
@@ -320,10 +607,21 @@ void drawDebugScreen(byte *state)
   txData.mode = debug;
   const byte yDistance = oled.getDisplayHeight() / 4; // Y-distance between objects (header object excluded)
   const byte xDistance = oled.getDisplayWidth() / 3;  // X-distance between objects
-  bool page = 0;                                      // Keeps track of which page the user is on
+  const byte pageCount = 3;                           // Number of information pages
+  const byte spectrumPage = 2;                        // Page with the spectrum analyzer
+  byte page = 0;                                      // Keeps track of which page the user is on
+  byte lastPage = 0;                                  // Page before the current one, the spectrum analyzer returns to it
 
   while (risingEdge(backButton) == false) // Stay in this mode until the user presses the back button
   {
+    if (page == spectrumPage) // The spectrum analyzer needs the radio and the display for itself
+    {
+      if (drawSpectrum() == false) // User pressed the back button
+        break;
+      page = lastPage;
+      continue;
+    }
+
     sendData(debug);  // Send data to the RC car
     oled.firstPage(); // Start drawing process
     do
@@ -347,7 +645,9 @@ void drawDebugScreen(byte *state)
         oled.setCursor(0, yDistance * 4);
         oled.print((String) "RA:" + (analogRead(batteryValue)));
         oled.setCursor(xDistance + 5, yDistance * 4);
-        oled.print((String) "VA:" + "NC");
+        oled.print((String) "VA:" + telemetry.batteryVoltage);
+        oled.setCursor(xDistance * 2 + 10, yDistance * 4);
+        oled.print((String) "RB:" + remotePercent + "%");
       }
       else // Second page is about the auxiliary buttons
       {
@@ -355,14 +655,25 @@ void drawDebugScreen(byte *state)
         oled.print((String) "AB1:" + digitalRead(auxButton1));
         oled.setCursor(xDistance + 5, yDistance * 2);
         oled.print((String) "AB2:" + digitalRead(auxButton2));
+        oled.setCursor(xDistance * 2 + 10, yDistance * 2); // Watchdog resets of the vehicle, should stay 0
+        oled.print((String) "WD:" + telemetry.watchdogResets);
+        oled.setCursor(0, yDistance * 3); // Power level and average retransmits of the remote
+        oled.print((String) "PA:" + paLevel);
+        oled.setCursor(xDistance + 5, yDistance * 3);
+        oled.print((String) "ARC:" + retryAverage / 16 + "." + (retryAverage % 16) * 10 / 16);
+        oled.setCursor(0, yDistance * 4); // Power level and lost packages of the vehicle
+        oled.print((String) "VPA:" + telemetry.paLevel);
+        oled.setCursor(xDistance + 5, yDistance * 4);
+        oled.print((String) "LOSS:" + telemetry.lostFrames + "%");
       }
-    } while (oled.nextPage()); // While still drawing
+    } while (nextPage()); // While still drawing
 
     // Switch infomation tabs when rightY joystick is moved
     int joystickValue = readJoystick(leftX);
-    if (joystickValue > joyStickHighTrigger || joystickValue < joyStickLowTrigger) // If the rightY joystick is moved, switch pages
+    if (joystickValue > joyStickHighTrigger || joystickValue < joyStickLowTrigger) // If the leftX joystick is moved, switch pages
     {
-      page = !page;
+      lastPage = page;
+      page = (page + (joystickValue > joyStickHighTrigger ? 1 : pageCount - 1)) % pageCount;
     }
   }
   *state = idle; // Return to idle mode
@@ -373,12 +684,25 @@ void drawHeader(const char *menuName)
 {
   oled.setFont(headerFont);
   const byte y = 15;
+  if (oled.getBufferCurrTileRow() == 0) // First page of a frame, the header reaches into the next pages
+    lowBanner = remoteLow && millis() / 1000 % 2;
+  if (lowBanner) // Warning banner in place of the name every other second
+  {
+    menuName = "Low battery";
+    oled.drawBox(0, 0, oled.getDisplayWidth(), y + 1);
+    oled.setFontMode(1); // Transparent, so only the letters are cleared
+    oled.setDrawColor(0);
+  }
   const byte x = ((oled.getDisplayWidth() - (oled.getUTF8Width(menuName))) / 2);
   oled.drawStr(x, y, menuName);
+  oled.setDrawColor(1);
+  oled.setFontMode(0);
   oled.drawHLine(0, y + 1, oled.getDisplayWidth());
 }
 
+const byte debounceTime = 5;                                   // ms a button has to settle before its next change counts
 bool lastButtonState[] = {HIGH, HIGH, HIGH, HIGH, HIGH, HIGH}; // Keeps track of the last button state
+unsigned long lastButtonChange[6];                             // millis() of the last change per button, debounces without blocking the frames
 // Rising edge detection function for all buttons
 bool risingEdge(byte button)
 {
@@ -409,15 +733,15 @@ bool risingEdge(byte button)
   }
 
   bool buttonState = digitalRead(button);
-  if (buttonState != lastButtonState[index]) // Detecting change
+  if (buttonState != lastButtonState[index] && millis() - lastButtonChange[index] >= debounceTime) // Detecting change, bounces right after the last one are ignored
   {
     lastButtonState[index] = buttonState; // Updating lastButtonState
+    lastButtonChange[index] = millis();
     if (buttonState == LOW)               // Button pressed
     {
       return true; // Rising edge detected
     }
   }
-  delay(2);     // Debounce
   return false; // No rising edge detected
 }
 
@@ -486,45 +810,96 @@ void drawBasicInfo()
     oled.drawStr(xDistance, yDistance * 2, "TL: Off");
   oled.setCursor(0, yDistance * 3);
   oled.print("RV: "); // Draw battery voltage of the remote
-  oled.print((analogRead(batteryValue) * 0.003225287) * 3, 1);
-  oled.print("V");
+  printVoltage(remoteVoltage);
   oled.setCursor(xDistance, yDistance * 3);
-  oled.print("VV: "); // Draw battery voltage of the vehicle
-  oled.print(12.6, 1);
-  oled.print("V");
+  oled.print("VV: "); // Draw battery voltage of the vehicle, measured by the vehicle
+  if (telemetry.batteryState == 2)
+    oled.print("LVC");
+  else
+  {
+    printVoltage(telemetry.batteryVoltage);
+    if (telemetry.batteryState == 1) // Throttle is halved by the vehicle
+      oled.print("!");
+  }
+}
+
+struct setting // Value of the active model profile that can be edited in pro mode
+{
+  const char *header; // Header of the edit page
+  const char *name;   // Description of the value
+  const char *label;  // Drawn in front of the value
+  const char *unit;   // Drawn behind the value
+  int min;            // Lowest allowed value
+  int max;            // Highest allowed value
+  byte step;          // Change per joystick movement
+  uint8_t *value;     // Location of the value in the active profile
+  bool isSigned;      // Value is stored as int8_t
+};
+const setting settings[] = {
+    {"Edit Throttle", "Throttle Sensitivity", "TR = ", "%", 5, 100, 5, &profile.throttleSensitifity, false},
+    {"Edit Steering", "Steering Sensitivity", "ST = ", "%", 5, 100, 5, &profile.steerSensitifity, false},
+    {"Throttle Trim", "Throttle Neutral", "TT = ", "", -30, 30, 1, (uint8_t *)&profile.vehicle.throttleTrim, true},
+    {"Steering Trim", "Steering Center", "STT = ", "", -30, 30, 1, (uint8_t *)&profile.vehicle.steerTrim, true},
+    {"Throttle Expo", "Throttle Curve", "TE = ", "%", 0, 100, 5, &profile.vehicle.throttleExpo, false},
+    {"Steering Expo", "Steering Curve", "SE = ", "%", 0, 100, 5, &profile.vehicle.steerExpo, false},
+    {"Failsafe", "Throttle Position", "FT = ", "", 0, 180, 5, &profile.vehicle.failsafeThrottle, false},
+    {"Failsafe", "Steering Position", "FS = ", "", 0, 180, 5, &profile.vehicle.failsafeSteer, false},
+    {"Failsafe", "Hold Time", "HT = ", "0ms", 2, 50, 1, &profile.vehicle.holdTime, false},
+    {"Failsafe", "Throttle Cut Time", "CT = ", "0ms", 5, 100, 5, &profile.vehicle.cutTime, false},
+    {"Failsafe", "Disconnect Time", "DT = ", "0ms", 20, 250, 10, &profile.vehicle.lostTime, false},
+    {"Battery", "Off LiPo LiFe NiMH", "BT = ", "", 0, 3, 1, &profile.vehicle.batteryType, false},
+    {"Battery", "Cells in Series", "BC = ", "S", 1, 8, 1, &profile.vehicle.batteryCells, false},
+    {"Steering", "Range at Full Speed", "SR = ", "%", 30, 100, 5, &profile.vehicle.steerAtSpeed, false},
+    {"Steering", "Expo at Full Speed", "SX = ", "%", 0, 100, 5, &profile.vehicle.speedExpo, false},
+    {"Throttle", "Acceleration us/ms", "TA = ", "", 0, 100, 1, &profile.vehicle.accelRate, false},
+    {"Throttle", "Deceleration us/ms", "TD = ", "", 0, 100, 1, &profile.vehicle.decelRate, false},
+    {"Throttle", "Soft Start", "TS = ", "0ms", 0, 250, 10, &profile.vehicle.softStart, false},
+    {"Throttle", "Launch Ramp", "TL = ", "0ms", 0, 250, 10, &profile.vehicle.launchTime, false},
+    {"Brake", "Car Crawler NoRev", "ET = ", "", 0, 2, 1, &profile.vehicle.escType, false},
+    {"Brake", "ABS Frequency", "AB = ", "Hz", 0, 20, 1, &profile.vehicle.absRate, false},
+    {"Hopping", "Frequency Hopping", "FH = ", "", 0, 1, 1, &profile.hopping, false},
+    {"Link", "Race Copies", "RC = ", "", 0, 4, 1, &profile.raceCopies, false},
+    {"Mixer", "Normal 4WS Tank", "MX = ", "", 0, 2, 1, &profile.mixerPreset, false},
+};
+const byte settingCount = sizeof(settings) / sizeof(settings[0]);
+
+// Reads the current value of an editable setting from the active profile
+int readSetting(const setting &item)
+{
+  if (item.isSigned)
+    return (int8_t)*item.value;
+  return *item.value;
 }
 
-// Draws the menu for editing the throttle and steering sensitivity in pro mode
+// Draws the menu for editing the settings of the active model profile in pro mode
 void drawEditProSettings()
 {
-  txData.mode = idle;                                               // Make sure the vehicle doesn't run away while editing the settings
-  unsigned long previousBlink = 0;                                  // Keeps track of the last time the selected value blinked
-  unsigned long scrollCooldown = 0;                                 // Slows the scrollling of possible values of the selected value
-  bool showCurrentValue = true;                                     // Keeps track of whether the selected value should be shown or not
-  bool valueHighlighted = false;                                    // Keeps track of whether the selected value is highlighted or not
-  bool page = 0;                                                    // Keeps track of the current page (0 = throttle, 1 = steering)
-  byte buffer = txData.throttleSensitifity;                         // Keeps track of the current value of the selected item
-  byte yDistance = oled.getDisplayHeight() / 4;                     // Y-distance between each object
-  String header[] = {"Edit Throttle", "Edit Steering"};             // Header for each page
-  String row1[] = {"Throttle Sensitivity", "Steering Sensitivity"}; // Row 1 for each page
-  String row2[] = {"TR = ", "ST = "};                               // Row 2 for each page
+  txData.mode = idle;                           // Make sure the vehicle doesn't run away while editing the settings
+  unsigned long previousBlink = 0;              // Keeps track of the last time the selected value blinked
+  unsigned long scrollCooldown = 0;             // Slows the scrollling of possible values of the selected value
+  bool showCurrentValue = true;                 // Keeps track of whether the selected value should be shown or not
+  bool valueHighlighted = false;                // Keeps track of whether the selected value is highlighted or not
+  byte page = 0;                                // Keeps track of the current page, every page edits one setting
+  int buffer = readSetting(settings[page]);     // Keeps track of the current value of the selected item
+  byte yDistance = oled.getDisplayHeight() / 4; // Y-distance between each object
 
   while (true) // Loop until user presses the back button
   {
+    const setting &item = settings[page];
     sendData(debug);  // Send data to the RC car
     oled.firstPage(); // Start drawing process
     do
     {
-      drawHeader(header[page].c_str());
+      drawHeader(item.header);
       oled.setFont(textFont);
-      byte x = ((oled.getDisplayWidth() - (oled.getUTF8Width(row1[page].c_str()))) / 2);                     // Calculate the x-position of the row 1
-      oled.drawStr(x, yDistance * 2.3, row1[page].c_str());                                                  // Draw row 1
-      x = ((oled.getDisplayWidth() - (oled.getUTF8Width(((String)row2[page] + buffer + "%").c_str()))) / 2); // Calculate the x-position of the row 2
+      byte x = ((oled.getDisplayWidth() - (oled.getUTF8Width(item.name))) / 2);                                 // Calculate the x-position of the row 1
+      oled.drawStr(x, yDistance * 2.3, item.name);                                                             // Draw row 1
+      x = ((oled.getDisplayWidth() - (oled.getUTF8Width(((String)item.label + buffer + item.unit).c_str()))) / 2); // Calculate the x-position of the row 2
       oled.setCursor(x, yDistance * 3.3);
-      oled.print(row2[page]); // Draw row 2
+      oled.print(item.label); // Draw row 2
       if (showCurrentValue)   // Draw the current value of the selected item
-        oled.print((String)buffer + "%");
-    } while (oled.nextPage()); // While still drawing
+        oled.print((String)buffer + item.unit);
+    } while (nextPage()); // While still drawing
 
     // Blinking of value when selected
     if ((millis() - previousBlink > 700) && valueHighlighted) // If the selected value should blink
@@ -536,16 +911,16 @@ void drawEditProSettings()
     // Scrolling of the selected value
     if ((millis() - scrollCooldown >= 100)) // If the scroll cooldown has expired, allow joystick input again
     {
-      scrollCooldown = millis();                                                        // Reset the scroll cooldown
-      if (valueHighlighted && (analogRead(rightY) > joyStickHighTrigger) && buffer > 5) // If the selected value is highlighted, value doesn't go below 5% and the joystick is moved to the up
+      scrollCooldown = millis();                                                                        // Reset the scroll cooldown
+      if (valueHighlighted && (analogRead(rightY) > joyStickHighTrigger) && buffer - item.step >= item.min) // If the selected value is highlighted, value doesn't go below the minimum and the joystick is moved to the up
       {
-        buffer -= 5;
+        buffer -= item.step;
         showCurrentValue = true;
         previousBlink = millis();
       }
-      else if (valueHighlighted && (analogRead(rightY) < joyStickLowTrigger) && buffer < 100) // If the selected value is highlighted, value doesn't exceed 100% and the joystick is moved to the down
+      else if (valueHighlighted && (analogRead(rightY) < joyStickLowTrigger) && buffer + item.step <= item.max) // If the selected value is highlighted, value doesn't exceed the maximum and the joystick is moved to the down
       {
-        buffer += 5;
+        buffer += item.step;
         showCurrentValue = true;
         previousBlink = millis();
       }
@@ -558,13 +933,12 @@ void drawEditProSettings()
         valueHighlighted = true;
       else // Save the selected value
       {
-        valueHighlighted = false;    // Unhighlight the selected value
-        showCurrentValue = true;     // Make sure the current value isn't hidden
-        EEPROM.update(page, buffer); // Save the selected value to the EEPROM
-        if (page == 0)               // First page is about throttle
-          txData.throttleSensitifity = buffer;
-        else // Second page is about steering
-          txData.steerSensitifity = buffer;
+        valueHighlighted = false; // Unhighlight the selected value
+        showCurrentValue = true;  // Make sure the current value isn't hidden
+        *item.value = buffer;     // Store the value in the active profile, int8_t values are stored as their two's complement
+        saveProfile();            // Save the active profile to the EEPROM
+        txData.throttleSensitifity = profile.throttleSensitifity;
+        txData.steerSensitifity = profile.steerSensitifity;
         drawValueSet();
       }
     }
@@ -579,19 +953,19 @@ void drawEditProSettings()
       {
         valueHighlighted = false;
         showCurrentValue = true;
-        buffer = EEPROM.read(page);
+        buffer = readSetting(item);
       }
     }
 
-    // Switch edit tabs when rightY joystick is moved
+    // Switch edit tabs when leftY joystick is moved
     int joystickValue = readJoystick(leftY);
-    if ((joystickValue > joyStickHighTrigger || joystickValue < joyStickLowTrigger) && valueHighlighted == false) // If the rightY joystick is moved, switch pages
+    if (valueHighlighted == false && (joystickValue > joyStickHighTrigger || joystickValue < joyStickLowTrigger)) // If the leftY joystick is moved, switch pages
     {
-      page = !page;
-      if (page == 0) // First page is about throttle
-        buffer = txData.throttleSensitifity;
-      else // Second page is about steering
-        buffer = txData.steerSensitifity;
+      if (joystickValue > joyStickHighTrigger)
+        page = (page + 1) % settingCount;
+      else
+        page = (page + settingCount - 1) % settingCount;
+      buffer = readSetting(settings[page]);
     }
   }
 }
@@ -645,4 +1019,666 @@ int readJoystick(byte joystick)
     return analogRead(joystick);
   }
   return 512;
-}
\ No newline at end of file
+}
+
+// EEPROM layout of the model memory, the Teensy LC emulates 128 bytes of EEPROM
+const byte eepromMagic = 0;         // Holds profileMagic when the EEPROM contains model profiles
+const byte eepromProfileSize = 1;   // Size of a profile when the profiles were stored, profiles are reset when the layout changes
+const byte eepromActiveProfile = 2; // Index of the last used profile
+const byte eepromProfiles = 3;      // First byte of the first profile
+const byte profileMagic = 0xA5;     // Never a valid sensitivity, so the old layout (throttle and steering sensitivity at 0 and 1) is recognized
+const byte profileCount = 4;        // Number of vehicles that can be stored
+static_assert(eepromProfiles + profileCount * sizeof(modelProfile) <= 128, "Model profiles don't fit in the EEPROM of the Teensy LC");
+
+// Returns the EEPROM address of a profile
+int profileAddress(byte index)
+{
+  return eepromProfiles + index * sizeof(modelProfile);
+}
+
+// Reads the last used profile from the EEPROM. Creates default profiles when the EEPROM holds none or an older layout
+void loadProfiles()
+{
+  if (EEPROM.read(eepromMagic) != profileMagic || EEPROM.read(eepromProfileSize) != sizeof(modelProfile))
+  {
+    modelProfile defaults;
+    byte oldThrottle = EEPROM.read(0);
+    byte oldSteer = EEPROM.read(1);
+    for (byte i = 0; i < profileCount; i++)
+      EEPROM.put(profileAddress(i), defaults);
+    if (oldThrottle >= 5 && oldThrottle <= 100 && oldSteer >= 5 && oldSteer <= 100) // Keep the sensitivities of the old layout in the first profile
+    {
+      defaults.throttleSensitifity = oldThrottle;
+      defaults.steerSensitifity = oldSteer;
+      EEPROM.put(profileAddress(0), defaults);
+    }
+    EEPROM.update(eepromActiveProfile, 0);
+    EEPROM.update(eepromProfileSize, sizeof(modelProfile));
+    EEPROM.update(eepromMagic, profileMagic); // Written last, so an interrupted reset is done again on the next startup
+  }
+
+  activeProfile = EEPROM.read(eepromActiveProfile);
+  if (activeProfile >= profileCount)
+    activeProfile = 0;
+}
+
+// Makes a profile the active one and points the radio to its vehicle. Takes effect right away, no reboot needed
+void applyProfile(byte index)
+{
+  activeProfile = index;
+  EEPROM.get(profileAddress(activeProfile), profile);
+  setLink(0); // A vehicle starts in the ARQ link, it is asked to switch over with the first packages
+  radio.openWritingPipe(profile.address);
+  radio.setChannel(profile.channel);
+  buildHopTable(profile.address, profile.channel, profile.hopBands, hopTable);
+  hopIndex = 0;
+  hopMask = 0;
+  txData.throttleSensitifity = profile.throttleSensitifity;
+  txData.steerSensitifity = profile.steerSensitifity;
+  configIndex = 0;
+  configBurst = configLength; // Get the settings of the profile to the vehicle without waiting for the send delay
+}
+
+// Saves the active profile to the EEPROM and sends the changed settings to the vehicle
+void saveProfile()
+{
+  EEPROM.put(profileAddress(activeProfile), profile);
+  configIndex = 0;
+  configBurst = configLength;
+}
+
+// Lets the user choose the vehicle that is controlled, the chosen profile is used right away
+void drawModelScreen(byte *state)
+{
+  txData.mode = idle;
+  char names[profileCount][16];
+  const char *items[profileCount];
+  for (byte i = 0; i < profileCount; i++) // Describe every profile with its channel, the active one gets a star
+  {
+    modelProfile stored;
+    EEPROM.get(profileAddress(i), stored);
+    snprintf(names[i], sizeof(names[i]), "Model %d CH%d%s", i + 1, stored.channel, i == activeProfile ? " *" : "");
+    items[i] = names[i];
+  }
+
+  byte cursor = activeProfile;
+  if (drawList("Model", items, profileCount, &cursor)) // User has chosen a profile
+  {
+    applyProfile(cursor);
+    EEPROM.update(eepromActiveProfile, activeProfile);
+  }
+  *state = idle; // Return to the menu
+}
+
+// Pairs the vehicle with the active profile. The vehicle has to be powered with the bind jumper placed, or never been bound before.
+// Looks for the quietest channels first, no vehicle listens to the remote while it binds
+void drawBindScreen(byte *state)
+{
+  txData.mode = idle;
+  surveyChannels();
+  drawSurvey();
+  const byte yDistance = oled.getDisplayHeight() / 4; // Y-distance between objects (header object excluded)
+  unsigned long previousBind = 0;                     // Used to limit the rate of bind requests
+  bool bound = false;                                 // Vehicle has confirmed the new address
+  bindPackage request;
+  generateAddress(request.address); // Every binding gets a new random address, so remotes don't control each other's vehicles
+  request.channel = surveyChannel; // Quietest channels of the survey
+  request.hopBands = surveyBands;
+
+  setLink(0);                        // Binding needs the acknowledgements
+  radio.openWritingPipe(address[0]); // Well-known bind address and channel
+  radio.setChannel(bindChannel);
+  radio.flush_rx();
+
+  while (bound == false && risingEdge(backButton) == false) // Stay in this mode until the vehicle confirms or the user presses the back button
+  {
+    oled.firstPage(); // Start drawing process
+    do
+    {
+      drawHeader("Bind");
+      oled.setFont(textFont);
+      oled.drawStr(0, yDistance * 2, "Power the vehicle");
+      oled.drawStr(0, yDistance * 3, "with bind jumper");
+      oled.drawStr(0, yDistance * 4, "Searching...");
+    } while (oled.nextPage()); // While still drawing
+
+    if (millis() - previousBind >= 50)
+    {
+      previousBind = millis();
+      flashSendLED(HIGH);
+      if (radio.write(&request, sizeof(bindPackage)) && radio.available()) // The vehicle answers with its copy of the request as ack payload
+      {
+        bindPackage confirmation;
+        radio.read(&confirmation, sizeof(bindPackage));
+        bound = memcmp(&confirmation, &request, sizeof(bindPackage)) == 0;
+      }
+      flashSendLED(LOW);
+    }
+  }
+
+  if (bound) // Store the new address in the profile
+  {
+    memcpy(profile.address, request.address, sizeof(profile.address));
+    profile.channel = request.channel;
+    profile.hopBands = request.hopBands;
+    saveProfile();
+    const char *prompt = "Bound!";
+    oled.setFont(headerFont);
+    oled.firstPage();
+    do
+    {
+      oled.drawStr((oled.getDisplayWidth() - oled.getUTF8Width(prompt)) / 2, oled.getDisplayHeight() / 2 + 5, prompt);
+    } while (oled.nextPage());
+    delay(500);
+  }
+  radio.flush_rx();
+  applyProfile(activeProfile); // Point the radio back to the vehicle of the profile
+  *state = idle;               // Return to the menu
+}
+
+// Creates a random RF address from the noise on the analog inputs
+void generateAddress(uint8_t *newAddress)
+{
+  uint32_t seed = micros();
+  for (byte i = 0; i < 32; i++) // Every conversion adds a few bits of noise
+    seed = (seed << 3) ^ (seed >> 29) ^ analogRead(batteryValue) ^ analogRead(rightX) ^ micros();
+  randomSeed(seed);
+  do
+  {
+    for (byte i = 0; i < 5; i++)
+      newAddress[i] = random(256);
+  } while (newAddress[0] == 0x00 || newAddress[0] == 0xFF || newAddress[0] == 0x55 || newAddress[0] == 0xAA); // The first byte on air must not look like the preamble or a flat line
+}
+
+// Use in place of oled.nextPage() in screens that control the vehicle. Keeps sending between two display pages, so the frame rate doesn't depend on the drawing time
+bool nextPage()
+{
+  sendData(sendMode);
+  return oled.nextPage();
+}
+
+// Returns the band of the hop range a channel belongs to, hopBandCount for channels outside of the hop range. Must be consistent with the receiver
+byte hopBand(byte channel)
+{
+  if (channel < hopLowest || channel > hopHighest)
+    return hopBandCount;
+  return (channel - hopLowest) * hopBandCount / (hopHighest - hopLowest + 1);
+}
+
+// Derives the hop sequence from the address of the vehicle. Slot 0 is the channel of the profile, so the vehicle can find the remote there. Must be consistent with the receiver
+void buildHopTable(const uint8_t *hopAddress, byte baseChannel, byte bands, byte *table)
+{
+  uint32_t seed = 0;
+  for (byte i = 0; i < 5; i++)
+    seed = seed * 31 + hopAddress[i];
+  seed |= 1; // Xorshift never leaves zero
+  byte allowed = 0;
+  for (byte i = 0; i < hopBandCount; i++)
+    allowed += (bands >> i) & 1;
+  if (allowed < 2) // Too few channels for a sequence, use the whole hop range
+    bands = 0xFF;
+
+  table[0] = baseChannel;
+  for (byte slot = 1; slot < hopCount; slot++)
+  {
+    bool used;
+    do // Draw channels until one is found that isn't in the sequence yet
+    {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      table[slot] = hopLowest + seed % (hopHighest - hopLowest + 1);
+      used = (bands & (1 << hopBand(table[slot]))) == 0; // Band is too busy
+      for (byte i = 0; i < slot; i++)
+        used |= table[i] == table[slot];
+    } while (used);
+  }
+}
+
+// Returns the slot after the given one that isn't skipped. Must be consistent with the receiver
+byte nextHopSlot(byte slot, uint16_t mask)
+{
+  for (byte i = 0; i < hopCount; i++)
+  {
+    slot = (slot + 1) % hopCount;
+    if ((mask & ((uint16_t)1 << slot)) == 0)
+      return slot;
+  }
+  return 0;
+}
+
+// Keeps loss counters per slot and drops slots that lose far more packages than the rest of the sequence
+void hop(bool delivered)
+{
+  hopSent[hopIndex]++;
+  if (delivered == false)
+    hopFailed[hopIndex]++;
+  if (hopSent[hopIndex] < 64) // Evaluate a slot every 64 packages
+    return;
+
+  unsigned int sent = 0;   // Packages of all slots
+  unsigned int failed = 0; // Lost packages of all slots
+  byte dropped = 0;        // Slots that are skipped already
+  for (byte i = 0; i < hopCount; i++)
+  {
+    sent += hopSent[i];
+    failed += hopFailed[i];
+    if (hopMask & ((uint16_t)1 << i))
+      dropped++;
+  }
+  // Only drop a slot when it loses more than half its packages while the link as a whole is fine, a vehicle out of range loses on all channels
+  if (hopIndex != 0 && hopFailed[hopIndex] > 32 && failed * 4 < sent && dropped < hopCount / 2)
+    hopMask |= (uint16_t)1 << hopIndex;
+  hopSent[hopIndex] = 0;
+  hopFailed[hopIndex] = 0;
+}
+
+// Samples all channels a few times for received power and picks the quietest channel and bands. Takes about 100 ms
+void surveyChannels()
+{
+  const byte passes = 4; // Passes over all channels, spread in time so short bursts of WiFi are caught too
+
+  memset(occupancy, 0, sizeof(occupancy));
+  radio.startListening();
+  for (byte pass = 0; pass < passes; pass++)
+    for (byte channel = 0; channel < channelCount; channel++)
+    {
+      tuneReceiver(channel);
+      if (radio.testRPD())
+        occupancy[channel]++;
+    }
+  radio.stopListening();
+  radio.setChannel(profile.channel);
+
+  // Quietest channel of the hop range, its neighbours count too because WiFi is wide
+  unsigned int best = 0xFFFF;
+  for (byte channel = hopLowest; channel <= hopHighest; channel++)
+  {
+    unsigned int noise = occupancy[channel] * 4;
+    for (byte i = 1; i <= 2; i++) // The hop range doesn't reach the edges, so the neighbours always exist
+      noise += occupancy[channel - i] + occupancy[channel + i];
+    if (noise < best)
+    {
+      best = noise;
+      surveyChannel = channel;
+    }
+  }
+
+  // Keep the quieter half of the bands
+  unsigned int bandNoise[hopBandCount] = {};
+  for (byte channel = hopLowest; channel <= hopHighest; channel++)
+    bandNoise[hopBand(channel)] += occupancy[channel];
+  surveyBands = 0;
+  for (byte kept = 0; kept < hopBandCount / 2; kept++)
+  {
+    byte quietest = hopBandCount;
+    for (byte band = 0; band < hopBandCount; band++)
+      if ((surveyBands & (1 << band)) == 0 && (quietest == hopBandCount || bandNoise[band] < bandNoise[quietest]))
+        quietest = band;
+    surveyBands |= 1 << quietest;
+  }
+}
+
+// Shows the result of the channel survey as a bar graph, one column per channel. Skipped with the acknowledge button or after a short time
+void drawSurvey()
+{
+  const byte graphBottom = 54; // Y-position of the base line of the graph
+  const byte barScale = 8;     // Height in pixels per sample with a signal
+  unsigned long shown = millis();
+
+  while (millis() - shown < 2000 && risingEdge(ackButton) == false)
+  {
+    oled.firstPage(); // Start drawing process
+    do
+    {
+      oled.setFont(textFont);
+      oled.setCursor(0, 10);
+      oled.print((String) "Quietest CH " + surveyChannel);
+      for (byte channel = 0; channel < channelCount; channel++)
+        if (occupancy[channel] > 0)
+          oled.drawVLine(channel + 1, graphBottom - occupancy[channel] * barScale, occupancy[channel] * barScale);
+      oled.drawHLine(0, graphBottom + 1, oled.getDisplayWidth());
+      oled.drawVLine(surveyChannel + 1, graphBottom + 2, 4); // Mark the chosen channel
+      for (byte channel = hopLowest; channel <= hopHighest; channel++) // Underline the chosen bands
+        if (surveyBands & (1 << hopBand(channel)))
+          oled.drawPixel(channel + 1, graphBottom + 8);
+    } while (oled.nextPage()); // While still drawing
+  }
+}
+
+// Moves the radio to a channel while it is listening, and waits until the received power can be measured
+void tuneReceiver(byte channel)
+{
+  digitalWrite(radioCE, LOW);
+  radio.setChannel(channel);
+  digitalWrite(radioCE, HIGH);
+  delayMicroseconds(170); // 130 us to settle in RX mode, 40 us to measure the received power
+}
+
+// Debug page that keeps sweeping all channels for received power and draws a bar graph with a decaying peak hold.
+// Only the tiles of the display that changed are sent, so a sweep and its update take a few tens of milliseconds.
+// The packages of the vehicle keep going out between the channels and the tiles, at the rate of the debug mode.
+// Returns false when the user presses the back button, true when the user moves on to another page.
+bool drawSpectrum()
+{
+  const byte graphTop = 2;                   // First tile row of the graph, the rows above are for the header
+  const byte graphRows = 6;                  // Tile rows of the graph
+  const byte graphHeight = graphRows * 8;    // Height of the graph in pixels
+  const byte peakDecay = 4;                  // Sweeps before the peak hold drops one pixel
+  const byte columns = channelCount / 8 + 1; // Tile columns that hold the channels, pixel column = channel + 1
+  byte level[channelCount];                  // Filtered share of samples with a signal, 0...255
+  byte peak[channelCount];                   // Peak hold of the bar height in pixels
+  byte drawnBar[channelCount];               // Bar height that is on the display
+  byte drawnPeak[channelCount];              // Peak hold that is on the display
+  bool dirty[columns];                       // Tile columns that have to be sent again
+  byte sweeps = 0;                           // Counts the sweeps for the decay of the peak hold
+  bool back = false;                         // User pressed the back button
+  memset(level, 0, sizeof(level));
+  memset(peak, 0, sizeof(peak));
+  memset(drawnBar, 0, sizeof(drawnBar));
+  memset(drawnPeak, 0, sizeof(drawnPeak));
+  memset(dirty, true, sizeof(dirty)); // First sweep draws the whole graph
+
+  oled.firstPage(); // Header is drawn once, the graph is updated tile by tile
+  do
+  {
+    drawHeader("Spectrum");
+  } while (oled.nextPage());
+
+  radio.startListening(); // Stays in RX mode, every channel costs two SPI transactions: set the channel and read the received power
+  while (true)
+  {
+    if (risingEdge(backButton))
+    {
+      back = true;
+      break;
+    }
+    int joystickValue = readJoystick(leftX);
+    if (joystickValue > joyStickHighTrigger || joystickValue < joyStickLowTrigger)
+      break;
+
+    sweeps++;
+    for (byte channel = 0; channel < channelCount; channel++)
+    {
+      sendWhileListening(debug);
+      tuneReceiver(channel);
+      int target = radio.testRPD() ? 255 : 0;
+      level[channel] += (target - level[channel]) / 4; // Smooth the single bit measurements
+      byte bar = (unsigned int)level[channel] * graphHeight / 256;
+      if (bar > peak[channel])
+        peak[channel] = bar;
+      else if (sweeps % peakDecay == 0 && peak[channel] > 0)
+        peak[channel]--;
+      if (bar != drawnBar[channel] || peak[channel] != drawnPeak[channel])
+        dirty[(channel + 1) / 8] = true;
+    }
+
+    for (byte column = 0; column < columns; column++) // Send the changed tile columns
+    {
+      if (dirty[column] == false)
+        continue;
+      sendWhileListening(debug);
+      dirty[column] = false;
+      uint8_t tiles[graphRows][8];
+      for (byte i = 0; i < 8; i++) // One byte per pixel column, bit 0 is the top pixel of the tile
+      {
+        int channel = column * 8 + i - 1;
+        uint64_t pixels = 0; // Bit 0 is the top pixel of the graph
+        if (channel >= 0 && channel < channelCount)
+        {
+          drawnBar[channel] = (unsigned int)level[channel] * graphHeight / 256;
+          drawnPeak[channel] = peak[channel];
+          if (drawnBar[channel] > 0)
+            pixels = (((uint64_t)1 << drawnBar[channel]) - 1) << (graphHeight - drawnBar[channel]);
+          if (drawnPeak[channel] > 0)
+            pixels |= (uint64_t)1 << (graphHeight - drawnPeak[channel]);
+        }
+        for (byte row = 0; row < graphRows; row++)
+          tiles[row][i] = pixels >> (row * 8);
+      }
+      for (byte row = 0; row < graphRows; row++)
+        u8x8_DrawTile(oled.getU8x8(), column, graphTop + row, 1, tiles[row]);
+    }
+  }
+  radio.stopListening();
+  radio.setChannel(profile.channel);
+  return back == false;
+}
+
+// Sends the package or race link copy that is due while the radio listens on another channel, then listens again
+void sendWhileListening(byte mode)
+{
+  bool copyDue = copiesLeft > 0 && micros() - copyTime >= framePeriod * 1000UL / linkCopies;
+  if (copyDue == false && millis() - previousSend < sendInterval(mode))
+    return;
+  radio.stopListening();
+  radio.setChannel(profile.hopping ? hopTable[hopIndex] : profile.channel);
+  sendData(mode);
+  radio.startListening();
+}
+
+byte powerWindow = 0;          // Packages since the last evaluation of the power level
+byte calmWindows = 0;          // Evaluations in a row with a clean link, the power only goes down after a few
+// Steps the power of the radio up when packages need retransmits or the vehicle misses packages, and slowly down again when the link is clean
+void adaptPower(bool delivered)
+{
+  byte retries = delivered ? radio.getARC() : 16;
+  retryAverage = retryAverage - retryAverage / 8 + retries * 2; // Exponential average, 16 = one retransmit per package
+  txData.retryAverage = min(retryAverage, 255u);                // Lets the vehicle adjust its power the same way
+  if (++powerWindow < 32)                                       // Evaluate every 32 packages
+    return;
+  powerWindow = 0;
+
+  if ((retryAverage > 32 || telemetry.lostFrames > 10) && paLevel < RF24_PA_MAX) // More than two retransmits per package or 10 % lost
+  {
+    paLevel++;
+    calmWindows = 0;
+    radio.setPALevel(paLevel);
+  }
+  else if (retryAverage < 4 && telemetry.lostFrames < 2 && paLevel > RF24_PA_MIN) // Almost no retransmits, wait a few evaluations before stepping down
+  {
+    if (++calmWindows >= 8)
+    {
+      paLevel--;
+      calmWindows = 0;
+      radio.setPALevel(paLevel);
+    }
+  }
+  else
+    calmWindows = 0;
+}
+
+// Sets the radio to the ARQ link (1 Mbps, acknowledgements and retransmits) or the race link (2 Mbps, no acknowledgements, every package is sent a few times)
+void setLink(byte copies)
+{
+  linkCopies = copies;
+  copiesLeft = 0;
+  if (copies > 0) // No acknowledgements, so no feedback for the power control either
+  {
+    radio.setAutoAck(false); // Also turns off the ack payloads
+    radio.setDataRate(RF24_2MBPS);
+    radio.setPALevel(RF24_PA_MAX);
+  }
+  else
+  {
+    radio.setAutoAck(true);
+    radio.enableAckPayload();
+    radio.setDataRate(RF24_1MBPS);
+    radio.setPALevel(paLevel);
+  }
+}
+
+// Moves the radio to the link of the active profile after a package that asked the vehicle to switch over
+void switchLink(bool delivered)
+{
+  if (linkCopies == 0 && delivered == false) // The vehicle listens at the data rate of the ARQ link until it has seen the request
+    return;
+  if (linkCopies > 0 && profile.raceCopies == 0) // Nothing is acknowledged in the race link, so repeat the request a few times
+    for (byte i = 0; i < 2; i++)
+      radio.write(&txData, sizeof(dataPackage));
+  setLink(profile.raceCopies);
+}
+
+// Compares the ARQ link with the race link on the vehicle of the active profile: share of the packages the vehicle missed, and the time until a package arrives
+void drawLinkTest(byte *state)
+{
+  txData.mode = idle;                                 // The vehicle stays in idle mode during the test
+  const byte yDistance = oled.getDisplayHeight() / 4; // Y-distance between objects (header object excluded)
+  const byte raceCopies = profile.raceCopies;         // Race link of the profile, restored after the test
+  byte arqLoss, raceLoss;
+  unsigned int arqLatency, raceLatency;
+
+  oled.firstPage(); // The display isn't updated during the test, so drawing doesn't delay the packages
+  do
+  {
+    drawHeader("Link test");
+    oled.setFont(textFont);
+    oled.drawStr(0, yDistance * 2, "Testing...");
+  } while (oled.nextPage());
+
+  testLink(0, &arqLoss, &arqLatency);
+  testLink(raceCopies > 0 ? raceCopies : 2, &raceLoss, &raceLatency);
+  profile.raceCopies = raceCopies;
+
+  while (risingEdge(backButton) == false) // Show the result until the user presses the back button
+  {
+    sendData(idle);
+    oled.firstPage(); // Start drawing process
+    do
+    {
+      drawHeader("Link test");
+      oled.setFont(textFont);
+      oled.drawStr(0, yDistance * 2, "Link  Loss  Time");
+      oled.setCursor(0, yDistance * 3);
+      if (arqLoss > 100)
+        oled.print("No vehicle");
+      else
+        oled.print((String) "ARQ   " + arqLoss + "%  " + arqLatency + "us");
+      oled.setCursor(0, yDistance * 4);
+      if (raceLoss > 100)
+        oled.print("Race  no answer");
+      else
+        oled.print((String) "Race  " + raceLoss + "%  " + raceLatency + "us");
+    } while (nextPage()); // While still drawing
+  }
+  *state = idle; // Return to the menu
+}
+
+// Drives one link for a few seconds at the frame rate. The loss is what the vehicle reports over its last 64 packages, 255 when the vehicle doesn't answer.
+// The latency of the ARQ link is the time until the acknowledgement, of the race link the time on air plus the wait for the first copy that arrived
+void testLink(byte copies, byte *loss, unsigned int *latency)
+{
+  const unsigned int testFrames = 256; // Enough for a few loss windows of the vehicle
+  unsigned long timeSum = 0;
+  unsigned int delivered = 0;
+  byte sequence = txData.sequence;
+
+  *loss = 255;
+  *latency = 0;
+  profile.raceCopies = copies;
+  unsigned long started = millis();
+  while (linkCopies != copies) // Wait until the vehicle has switched over
+  {
+    if (millis() - started > 1000)
+      return;
+    sendData(easy); // Full frame rate, the vehicle stays in idle mode because of txData.mode
+  }
+
+  for (unsigned int frames = 0; frames < testFrames;)
+  {
+    sendData(easy);
+    if (txData.sequence == sequence) // No new frame yet
+      continue;
+    sequence = txData.sequence;
+    frames++;
+    if (lastDelivered)
+    {
+      timeSum += writeTime;
+      delivered++;
+    }
+  }
+  if (delivered > 0)
+    *latency = timeSum / delivered;
+
+  if (copies > 0) // The status of the vehicle only comes back in the ARQ link
+  {
+    profile.raceCopies = 0;
+    byte count = telemetryCount;
+    started = millis();
+    while (telemetryCount - count < 2) // The first status may still be from before the race link
+    {
+      if (millis() - started > 1000)
+        return;
+      sendData(easy);
+    }
+    *latency += (unsigned long)telemetry.firstCopy * framePeriod * 1000 / copies / 16;
+  }
+  *loss = telemetry.lostFrames;
+}
+
+// Discharge curve of a LiPo cell, used for the charge of the remote
+struct chargePoint
+{
+  uint16_t millivolts; // Voltage of one cell without load
+  uint8_t percent;     // Charge left at that voltage
+};
+const chargePoint dischargeCurve[] = {
+    {3300, 0}, {3600, 5}, {3700, 15}, {3750, 30}, {3800, 45}, {3850, 60}, {3950, 75}, {4050, 88}, {4200, 100},
+};
+const byte remoteCells = 2;                // 2S LiPo, the divider of 1:3 on A6 measures up to 9.9 V
+const byte remoteLowPercent = 15;          // Below this the user gets warned
+const unsigned int remoteFullScale = 9900; // mV at the full scale of the ADC
+unsigned long lastBatterySample = 0;       // Time of the last sample of the battery of the remote
+unsigned long remoteFiltered = 0;          // Filtered voltage in mV x16, 0 until the first sample
+// Samples the battery of the remote every 20 ms in the background, filters it and estimates the charge. Also blinks the send LED when the battery is low
+void updateRemoteBattery()
+{
+  if (remoteLow) // Double blink every second
+    digitalWrite(sendLED, millis() % 1000 < 300 && millis() % 1000 / 100 != 1);
+  if (millis() - lastBatterySample < 20)
+    return;
+  lastBatterySample = millis();
+
+  unsigned long millivolts = (unsigned long)analogRead(batteryValue) * remoteFullScale / 1023;
+  if (remoteFiltered == 0) // First sample, don't start from 0 V
+    remoteFiltered = millivolts << 4;
+  else // About 1 s time constant, the radio and the backlight make the voltage jump
+    remoteFiltered = remoteFiltered - (remoteFiltered >> 6) + (millivolts >> 2);
+  remoteVoltage = remoteFiltered >> 4;
+
+  unsigned int cell = remoteVoltage / remoteCells;
+  const byte points = sizeof(dischargeCurve) / sizeof(dischargeCurve[0]);
+  if (cell <= dischargeCurve[0].millivolts)
+    remotePercent = 0;
+  else if (cell >= dischargeCurve[points - 1].millivolts)
+    remotePercent = 100;
+  else
+    for (byte i = 1; i < points; i++) // Linear between the points of the curve
+      if (cell < dischargeCurve[i].millivolts)
+      {
+        const chargePoint &low = dischargeCurve[i - 1];
+        const chargePoint &high = dischargeCurve[i];
+        remotePercent = low.percent + (unsigned long)(cell - low.millivolts) * (high.percent - low.percent) / (high.millivolts - low.millivolts);
+        break;
+      }
+  if (remotePercent < remoteLowPercent) // A bit of hysteresis, so the warning doesn't flicker
+    remoteLow = true;
+  else if (remotePercent > remoteLowPercent + 5 && remoteLow)
+  {
+    remoteLow = false;
+    digitalWrite(sendLED, LOW); // End of the double blink, the packages flash the LED again
+  }
+}
+
+// Flashes the send LED with a package. While the battery of the remote is low the LED keeps the double blink of updateRemoteBattery()
+void flashSendLED(bool on)
+{
+  if (remoteLow == false)
+    digitalWrite(sendLED, on);
+}
+
+// Prints a voltage with one decimal, like 7.4V
+void printVoltage(unsigned int millivolts)
+{
+  oled.print((String)(millivolts / 1000) + "." + millivolts / 100 % 10 + "V");
+}
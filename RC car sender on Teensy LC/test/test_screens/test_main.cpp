@@ -0,0 +1,278 @@
+/*  Golden image tests and render benchmark of the screens of the remote. Every screen is drawn from a fixed model state into the emulated
+    SH1106 of the Linux backend, which keeps the display RAM as the panel shows it, and compared pixel by pixel with its image in golden/.
+    A screen that differs is written next to its golden image as <screen>.actual.pbm. A missing golden image fails the same way, a run
+    never writes into golden/ by itself. UPDATE_GOLDEN=1 records all of them, for a new screen or after a change that is meant to show on
+    the screen, then commit the images.
+    Per screen the host time of a frame and the bytes and time of a frame on the I2C bus are printed, so a faster drawing of a screen
+    can be checked for speed and against its golden image.
+
+    Run with: pio test -e native
+*/
+
+#include <unity.h>
+#include <Arduino.h> // The headers of the program, so the define below only reaches the program itself
+#include <LibPrintf.h>
+#include <EEPROM.h>
+#include <U8g2lib.h>
+#include <hal_display.h>
+#include <RF24.h>
+#include <nRF24l01.h>
+#include <hal_linux.h>
+#include <hal_sim_air.h>
+#include <time.h>
+#include <sys/stat.h>
+
+halSimAir air; // Before the program, so it outlives the radio of the program at exit. No vehicle answers on it
+
+#define printf silentPrintf // The program prints its errors on the serial monitor
+int silentPrintf(const char *format, ...)
+{
+  (void)format;
+  return 0;
+}
+#include "../../src/main.cpp"
+#undef printf
+
+// Data types
+struct screenResult // Measurements of one screen, printed at the end
+{
+  const char *name;
+  unsigned int frames;
+  double hostMicros;      // us per frame on the host, drawing and the rest of the loop of the screen
+  unsigned long busBytes; // Bytes per frame on the I2C bus
+};
+
+// Prototypes
+void runScreen(const char *name, void (*draw)(), byte exitButton, unsigned int frames);
+uint8_t frameBytes(u8x8_t *u8x8, uint8_t msg, uint8_t length, void *data);
+void goldenPath(const char *name, const char *extension, char *path);
+bool writeImage(const char *path);
+bool readImage(const char *path, bool *pixels);
+void printResults();
+
+// Global variables
+const unsigned int benchmarkFrames = 20; // Frames per screen, the loop of the screen ends after them
+const byte screenWidth = 128;
+const byte screenHeight = 64;
+const size_t pathSize = 512;
+screenResult results[16];
+byte resultCount = 0;
+unsigned int framesDrawn = 0;  // Frames sent to the display since runScreen() started
+unsigned int framesWanted = 0; // The exit button is pressed after this many frames, 0 = the screen ends by itself
+byte pressAfterFrames = 0;     // Button that ends the loop of the screen
+byte screenState = idle;       // State the screens with a state machine argument write to
+
+void setUp()
+{
+  profile = modelProfile(); // The stock profile, saved on a remote that was never set up
+  txData = dataPackage();
+  txData.headLight = true;
+  telemetry = telemetryPackage();
+  telemetry.batteryVoltage = 7412; // Two LiPo cells
+  telemetry.paLevel = RF24_PA_LOW;
+  telemetry.lostFrames = 3;
+  paLevel = RF24_PA_MIN;
+  retryAverage = 0;
+  halSetAnalog(batteryValue, 820); // About 3.9 V per cell on the remote, the filter of updateRemoteBattery() starts right there
+  remoteFiltered = 0;
+  remoteLow = false;
+  const byte buttons[] = {rightJoystickButton, leftJoystickButton, ackButton, backButton, auxButton1, auxButton2};
+  for (byte i = 0; i < sizeof(buttons); i++)
+  {
+    halSetDigital(buttons[i], HIGH);
+    lastButtonState[i] = HIGH;
+  }
+  const byte sticks[] = {rightX, rightY, leftX, leftY};
+  for (byte stick : sticks)
+    halSetAnalog(stick, 512);
+  for (bool &homed : joystickHomed)
+    homed = true;
+  menuIndex = 0;
+}
+
+void tearDown()
+{
+}
+
+// The animation slides the name in from the top, the last frame is compared
+void test_startup_screen()
+{
+  runScreen("startup", drawStartupScreen, 0, 0);
+}
+
+void test_menu()
+{
+  runScreen("menu", [] { drawMenu(&screenState); }, ackButton, benchmarkFrames);
+}
+
+void test_easy_screen()
+{
+  runScreen("easy", [] { drawEasyScreen(&screenState); }, backButton, benchmarkFrames);
+}
+
+void test_pro_screen()
+{
+  runScreen("pro", [] { drawProScreen(&screenState); }, backButton, benchmarkFrames);
+}
+
+// First page of the debug screen: sticks, buttons and battery voltages
+void test_debug_screen()
+{
+  runScreen("debug", [] { drawDebugScreen(&screenState); }, backButton, benchmarkFrames);
+}
+
+// First page of the settings, the throttle sensitivity
+void test_edit_pro_settings()
+{
+  runScreen("edit-pro-settings", drawEditProSettings, backButton, benchmarkFrames);
+}
+
+void test_value_set()
+{
+  runScreen("value-set", drawValueSet, 0, 0);
+}
+
+// Runs a screen until it has drawn the frames, then presses the exit button. Compares the last frame with the golden image
+void runScreen(const char *name, void (*draw)(), byte exitButton, unsigned int frames)
+{
+  halSh1106 &screen = halScreen();
+  memset(screen.ram, 0, sizeof(screen.ram));
+  framesDrawn = 0;
+  framesWanted = frames;
+  pressAfterFrames = exitButton;
+  unsigned long busStart = screen.busBytes;
+  struct timespec started, finished;
+  clock_gettime(CLOCK_MONOTONIC, &started);
+  draw();
+  clock_gettime(CLOCK_MONOTONIC, &finished);
+  framesWanted = 0;
+  TEST_ASSERT_TRUE_MESSAGE(framesDrawn > 0, "the screen didn't draw a frame");
+  if (frames > 0)
+    TEST_ASSERT_EQUAL_MESSAGE(frames, framesDrawn, "the screen didn't end after the exit button");
+  double micros = ((finished.tv_sec - started.tv_sec) * 1e9 + (finished.tv_nsec - started.tv_nsec)) / 1e3;
+  results[resultCount++] = {name, framesDrawn, micros / framesDrawn, (screen.busBytes - busStart) / framesDrawn};
+
+  static char golden[pathSize], actual[pathSize], message[2 * pathSize + 64]; // Unity leaves the test with a longjmp, no destructors on the way
+  goldenPath(name, ".pbm", golden);
+  goldenPath(name, ".actual.pbm", actual);
+  static bool expected[screenWidth * screenHeight];
+  const char *update = getenv("UPDATE_GOLDEN");
+  if (update && strcmp(update, "1") == 0)
+  {
+    TEST_ASSERT_TRUE_MESSAGE(writeImage(golden), "can't write the golden image");
+    snprintf(message, sizeof(message), "golden image recorded: %s", golden);
+    TEST_IGNORE_MESSAGE(message);
+  }
+  if (!readImage(golden, expected))
+  {
+    writeImage(actual);
+    snprintf(message, sizeof(message), "no golden image %s, see %s and record it with UPDATE_GOLDEN=1", golden, actual);
+    TEST_FAIL_MESSAGE(message);
+  }
+  unsigned int different = 0;
+  for (int y = 0; y < screenHeight; y++)
+    for (int x = 0; x < screenWidth; x++)
+      different += halPixel(x, y) != expected[y * screenWidth + x];
+  if (different == 0)
+  {
+    remove(actual);
+    return;
+  }
+  writeImage(actual);
+  snprintf(message, sizeof(message), "%u pixels differ from the golden image, see %s", different, actual);
+  TEST_FAIL_MESSAGE(message);
+}
+
+// Byte procedure of the display: the one of the emulated SH1106, and counts the frames. A frame ends with the last column of the last page
+uint8_t frameBytes(u8x8_t *u8x8, uint8_t msg, uint8_t length, void *data)
+{
+  uint8_t result = halSh1106Bytes(u8x8, msg, length, data);
+  halSh1106 &screen = halScreen();
+  if (msg != U8X8_MSG_BYTE_END_TRANSFER || !screen.dataTransfer || screen.page != 7 || screen.column < screenWidth + 2)
+    return result;
+  framesDrawn++;
+  if (framesWanted > 0 && framesDrawn == framesWanted && pressAfterFrames)
+    halSetDigital(pressAfterFrames, LOW);
+  return result;
+}
+
+// File of a screen in the golden folder next to this file, path holds pathSize characters
+void goldenPath(const char *name, const char *extension, char *path)
+{
+  const char *slash = strrchr(__FILE__, '/');
+  int folder = slash ? slash - __FILE__ + 1 : 0;
+  snprintf(path, pathSize, "%.*sgolden/%s%s", folder, __FILE__, name, extension);
+}
+
+// Writes the screen as a plain PBM, one character per pixel so a change shows in a diff. 1 = pixel on
+bool writeImage(const char *path)
+{
+  char folder[pathSize];
+  snprintf(folder, sizeof(folder), "%.*s", (int)(strrchr(path, '/') - path), path);
+  mkdir(folder, 0777); // The first image creates the golden folder
+  FILE *file = fopen(path, "w");
+  if (file == nullptr)
+    return false;
+  fprintf(file, "P1\n%u %u\n", screenWidth, screenHeight);
+  for (int y = 0; y < screenHeight; y++)
+  {
+    for (int x = 0; x < screenWidth; x++)
+      fputc(halPixel(x, y) ? '1' : '0', file);
+    fputc('\n', file);
+  }
+  return fclose(file) == 0;
+}
+
+// Reads a plain PBM of the size of the screen. Returns false when there is none
+bool readImage(const char *path, bool *pixels)
+{
+  FILE *file = fopen(path, "r");
+  if (file == nullptr)
+    return false;
+  unsigned int width = 0, height = 0;
+  bool valid = fscanf(file, "P1 %u %u", &width, &height) == 2 && width == screenWidth && height == screenHeight;
+  for (int i = 0; valid && i < screenWidth * screenHeight; i++)
+  {
+    int c;
+    do
+      c = fgetc(file);
+    while (c == ' ' || c == '\n' || c == '\r' || c == '\t');
+    valid = c == '0' || c == '1';
+    pixels[i] = c == '1';
+  }
+  fclose(file);
+  return valid;
+}
+
+void printResults()
+{
+  printf("\n%-18s %7s %14s %16s %14s\n", "screen", "frames", "host us/frame", "bus bytes/frame", "bus ms/frame");
+  for (byte i = 0; i < resultCount; i++)
+  {
+    double busMillis = results[i].busBytes * 9 / 400.0; // 9 bits per byte at the 400 kHz of setup()
+    printf("%-18s %7u %14.1f %16lu %14.2f\n", results[i].name, results[i].frames, results[i].hostMicros, results[i].busBytes, busMillis);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  halSelectBoard(halNewBoard()); // Erased EEPROM, the stock profiles
+  halUseVirtualClock();
+  halSetAir(&air);
+  setup(); // Draws the startup screen once, before the frames are counted
+  oled.getU8x8()->byte_cb = frameBytes;
+
+  UNITY_BEGIN();
+  RUN_TEST(test_startup_screen);
+  RUN_TEST(test_menu);
+  RUN_TEST(test_easy_screen);
+  RUN_TEST(test_pro_screen);
+  RUN_TEST(test_debug_screen);
+  RUN_TEST(test_edit_pro_settings);
+  RUN_TEST(test_value_set);
+  int failures = UNITY_END();
+  printResults();
+  return failures;
+}
@@ -0,0 +1,491 @@
+/*  Tool for the captures of the radio link, see hal_capture.h: the receiver on Linux, or the simulator, writes one when HAL_CAPTURE names a file.
+    Prints a summary of a capture: the kinds of frames, the channels, the gaps between the packages, the lost and invalid packages and the modes.
+    -d decodes every frame into a line. -c, -w and -k filter the frames, -o writes the frames that are left to a new capture.
+    -r replays the packages of the remote into the vehicle program, at the times they were received, on a virtual clock. The servo outputs
+    go to a timeline in the format of the simulator, and a digest of them is printed, the same capture gives the same digest every time.
+    The vehicle starts with the EEPROM image of -e, the HAL_EEPROM file of the receiver, or else bound to a stand-in remote on the first channel.
+    -b measures how fast the capture decodes: reading the records, telling the kinds apart and validating the packages.
+
+    Usage: program [-d] [-c channel] [-w from:to] [-k packages|acks] [-o filtered.rcap] [-r timeline.csv] [-e eeprom] [-b] capture.rcap
+*/
+
+#include <Arduino.h>
+#include <LibPrintf.h>
+#include <EEPROM.h>
+#include <Servo.h>
+#include <SPI.h>
+#include <hal.h>
+#include <nRF24L01.h>
+#include <RF24.h>
+#include <hal_linux.h>
+#include <hal_sim_air.h>
+#include <hal_capture.h>
+#include <unistd.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+halSimAir replayAir; // Before the program, so it outlives the radio of the program at exit. The radio of the vehicle is alone on it
+
+#define printf silentPrintf // The vehicle prints every rejected package and its status, the output of the tool is the summary
+int silentPrintf(const char *format, ...)
+{
+  (void)format;
+  return 0;
+}
+namespace vehicle
+{
+#include "../../RC car receiver on Pro Mini/src/main.cpp"
+}
+#undef printf
+
+// Data types
+struct captureFilter // Frames the summary, the decoding, the new capture and the replay look at
+{
+  int channel = -1;                        // -1 = all
+  unsigned long long from = 0;             // us
+  unsigned long long to = ~0ULL;           // us
+  int kind = -1;                           // -1 = all, 0 = frames received by a radio, 1 = ack payloads
+};
+
+// Prototypes
+bool loadCapture(const char *path, std::vector<uint8_t> &data);
+bool parseWindow(const char *text, captureFilter &filter);
+bool passes(const halCaptureRecord &record, const captureFilter &filter);
+byte frameKind(const halCaptureRecord &record);
+void decodeRecord(const halCaptureRecord &record);
+void printSummary(const std::vector<halCaptureRecord> &records, unsigned int sessions);
+bool writeCapture(const char *path, const std::vector<halCaptureRecord> &records);
+bool replay(const std::vector<halCaptureRecord> &records, const char *timelinePath, const char *eepromPath);
+void deliverRecord(const halCaptureRecord &record);
+bool recordOutputs(FILE *timeline);
+void benchmark(const std::vector<uint8_t> &data);
+unsigned long long percentile(std::vector<unsigned long long> &values, unsigned int percent);
+
+// Global variables
+const byte kindPackage = 0; // Kinds of frames
+const byte kindTelemetry = 1;
+const byte kindBind = 2;
+const byte kindOther = 3;
+const char *const kindNames[] = {"package", "telemetry", "bind", "other"};
+const char *const modeNames[] = {"idle", "easy", "pro", "debug", "not connected", "binding"};
+const byte servoPins[] = {5, 3, vehicle::aux1Pin, vehicle::aux2Pin}; // Steering, motor controller and the aux outputs, the columns of the timeline
+const unsigned int loopMicros = 250;     // us one pass of loop() takes on the Pro Mini, like in the simulator
+const unsigned long replayTail = 20000;  // us the vehicle runs on after the last package, so it acts on it
+const double benchmarkSeconds = 1;       // Wall time the decoding is repeated for
+int lastOutputs[sizeof(servoPins)];
+unsigned long outputChanges = 0;
+uint32_t outputDigest = 2166136261u;     // FNV-1a over the timeline
+byte pid = 0;                            // Packet id of the replayed frames, tells a new frame apart from a retransmit
+
+int main(int argc, char **argv)
+{
+  captureFilter filter;
+  bool decode = false;
+  bool measure = false;
+  const char *outputPath = nullptr;
+  const char *timelinePath = nullptr;
+  const char *eepromPath = nullptr;
+  int option;
+  while ((option = getopt(argc, argv, "dc:w:k:o:r:e:b")) != -1)
+  {
+    switch (option)
+    {
+    case 'd':
+      decode = true;
+      break;
+    case 'c':
+      filter.channel = atoi(optarg);
+      break;
+    case 'w':
+      if (!parseWindow(optarg, filter))
+        argc = 0; // Usage
+      break;
+    case 'k':
+      filter.kind = strcmp(optarg, "packages") == 0 ? 0 : strcmp(optarg, "acks") == 0 ? 1 : -2;
+      break;
+    case 'o':
+      outputPath = optarg;
+      break;
+    case 'r':
+      timelinePath = optarg;
+      break;
+    case 'e':
+      eepromPath = optarg;
+      break;
+    case 'b':
+      measure = true;
+      break;
+    default:
+      argc = 0;
+    }
+  }
+  if (argc == 0 || optind != argc - 1 || filter.kind == -2)
+  {
+    fprintf(stderr, "Usage: %s [-d] [-c channel] [-w from:to] [-k packages|acks] [-o filtered.rcap] [-r timeline.csv] [-e eeprom] [-b] capture.rcap\n",
+            argv[0]);
+    return 2;
+  }
+
+  std::vector<uint8_t> data;
+  if (!loadCapture(argv[optind], data))
+    return 1;
+  halCaptureReader reader(data.data(), data.size());
+  std::vector<halCaptureRecord> records;
+  halCaptureRecord record;
+  while (reader.next(&record))
+  {
+    if (!passes(record, filter))
+      continue;
+    records.push_back(record);
+    if (decode)
+      decodeRecord(record);
+  }
+  if (reader.broken())
+    fprintf(stderr, "%s is cut off or broken after %zu records\n", argv[optind], records.size());
+
+  printSummary(records, reader.sessions);
+  if (outputPath && !writeCapture(outputPath, records))
+    return 1;
+  if (measure)
+    benchmark(data);
+  if (timelinePath && !replay(records, timelinePath, eepromPath))
+    return 1;
+  return 0;
+}
+
+// Reads a whole capture, false with a message when it can't be read or isn't one
+bool loadCapture(const char *path, std::vector<uint8_t> &data)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr)
+  {
+    perror(path);
+    return false;
+  }
+  uint8_t buffer[65536];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    data.insert(data.end(), buffer, buffer + length);
+  fclose(file);
+  if (!halCaptureReader(data.data(), data.size()).valid())
+  {
+    fprintf(stderr, "%s is not a capture of version %u\n", path, halCaptureVersion);
+    return false;
+  }
+  return true;
+}
+
+// "<from>:<to>" in seconds, either side may be left out
+bool parseWindow(const char *text, captureFilter &filter)
+{
+  const char *colon = strchr(text, ':');
+  if (colon == nullptr)
+    return false;
+  if (colon != text)
+    filter.from = (unsigned long long)(atof(text) * 1e6);
+  if (colon[1] != '\0')
+    filter.to = (unsigned long long)(atof(colon + 1) * 1e6);
+  return filter.from <= filter.to;
+}
+
+bool passes(const halCaptureRecord &record, const captureFilter &filter)
+{
+  if (filter.channel >= 0 && record.channel != filter.channel)
+    return false;
+  if (record.time < filter.from || record.time > filter.to)
+    return false;
+  return filter.kind < 0 || filter.kind == (record.ack ? 1 : 0);
+}
+
+// Tells the frames apart by their length, the same way the programs do
+byte frameKind(const halCaptureRecord &record)
+{
+  if (record.ack)
+    return record.length == sizeof(vehicle::telemetryPackage) ? kindTelemetry : kindOther;
+  if (record.length == sizeof(vehicle::dataPackage))
+    return kindPackage;
+  if (record.length == sizeof(vehicle::bindPackage) && memcmp(record.payload, "BND", 3) == 0)
+    return kindBind;
+  return kindOther;
+}
+
+// One line per frame: seconds, channel, pipe, length, kind and the fields
+void decodeRecord(const halCaptureRecord &record)
+{
+  printf("%12.6f ch %3u pipe %u len %2u %s", record.time / 1e6, record.channel, record.pipe, record.length,
+         record.noAck && !record.ack ? "noack " : "");
+  switch (frameKind(record))
+  {
+  case kindPackage:
+  {
+    vehicle::dataPackage package;
+    memcpy(&package, record.payload, sizeof(package));
+    bool valid = vehicle::validateData(package);
+    printf("package seq %3u mode %i sticks %i %i %i %i sens %i %i buttons %i%i%i%i%i%i%i%i%i%i config %u=%u hop %u mask %04X copy %u/%u retries %u%s\n",
+           package.sequence, package.mode, package.rightX, package.rightY, package.leftX, package.leftY, package.throttleSensitifity,
+           package.steerSensitifity, package.rightJoystickButton, package.leftJoystickButton, package.ackButton, package.backButton,
+           package.auxButton1, package.auxButton2, package.brake, package.honk, package.headLight, package.tailLight, package.configIndex,
+           package.configValue, package.hopIndex, package.hopMask, package.copy, package.copies, package.retryAverage, valid ? "" : " invalid");
+    break;
+  }
+  case kindTelemetry:
+  {
+    vehicle::telemetryPackage telemetry;
+    memcpy(&telemetry, record.payload, sizeof(telemetry));
+    printf("telemetry lost %u %% pa %u first %u resets %u/%u/%u battery %u mV state %u\n", telemetry.lostFrames, telemetry.paLevel,
+           telemetry.firstCopy, telemetry.watchdogResets, telemetry.brownoutResets, telemetry.externalResets, telemetry.batteryVoltage,
+           telemetry.batteryState);
+    break;
+  }
+  case kindBind:
+  {
+    vehicle::bindPackage bind;
+    memcpy(&bind, record.payload, sizeof(bind));
+    printf("bind address %02X%02X%02X%02X%02X channel %u bands %02X\n", bind.address[4], bind.address[3], bind.address[2], bind.address[1],
+           bind.address[0], bind.channel, bind.hopBands);
+    break;
+  }
+  default:
+    printf("other");
+    for (byte i = 0; i < record.length; i++)
+      printf(" %02X", record.payload[i]);
+    printf("\n");
+  }
+}
+
+void printSummary(const std::vector<halCaptureRecord> &records, unsigned int sessions)
+{
+  unsigned long kinds[4] = {0};
+  unsigned long channels[126] = {0};
+  unsigned long modes[6] = {0};
+  unsigned long invalid = 0, lost = 0, duplicates = 0, packages = 0;
+  std::vector<unsigned long long> gaps;
+  unsigned long long lastPackage = 0;
+  byte lastSequence = 0;
+  for (const halCaptureRecord &record : records)
+  {
+    byte kind = frameKind(record);
+    kinds[kind]++;
+    channels[min(record.channel, (uint8_t)125)]++;
+    if (kind != kindPackage)
+      continue;
+    vehicle::dataPackage package;
+    memcpy(&package, record.payload, sizeof(package));
+    if (!vehicle::validateData(package))
+    {
+      invalid++;
+      continue;
+    }
+    modes[package.mode]++;
+    if (packages > 0)
+    {
+      byte step = package.sequence - lastSequence;
+      if (step == 0 && package.copies > 0) // Later copy of the race link
+      {
+        duplicates++;
+        continue;
+      }
+      gaps.push_back(record.time - lastPackage);
+      if (step > 1 && step < 128) // A bigger step is a remote that started again
+        lost += step - 1;
+    }
+    packages++;
+    lastPackage = record.time;
+    lastSequence = package.sequence;
+  }
+
+  double seconds = records.empty() ? 0 : (records.back().time - records.front().time) / 1e6;
+  printf("%zu frames in %u session%s, %.3f s\n", records.size(), sessions, sessions == 1 ? "" : "s", seconds);
+  printf("Kinds:");
+  for (byte i = 0; i < 4; i++)
+    printf(" %s %lu", kindNames[i], kinds[i]);
+  printf("\nChannels:");
+  for (byte i = 0; i < 126; i++)
+    if (channels[i] > 0)
+      printf(" %u (%lu)", i, channels[i]);
+  printf("\nPackages: %lu valid, %lu invalid, %lu copies of the race link, %lu lost by the sequence (%.1f %%)\n", packages, invalid, duplicates,
+         lost, packages + lost > 0 ? 100.0 * lost / (packages + lost) : 0.0);
+  printf("Modes:");
+  for (byte i = 0; i < 6; i++)
+    if (modes[i] > 0)
+      printf(" %s %lu", modeNames[i], modes[i]);
+  printf("\n");
+  if (gaps.empty())
+    return;
+  unsigned long long hold = vehicle::vehicleConfig().holdTime * 10000ULL;
+  unsigned long holds = std::count_if(gaps.begin(), gaps.end(), [hold](unsigned long long gap) { return gap > hold; });
+  printf("Gaps between packages: p50 %.1f ms, p99 %.1f ms, max %.1f ms, %lu longer than the default hold time of %llu ms\n",
+         percentile(gaps, 50) / 1e3, percentile(gaps, 99) / 1e3, percentile(gaps, 100) / 1e3, holds, hold / 1000);
+}
+
+// Writes the frames as a capture of one session
+bool writeCapture(const char *path, const std::vector<halCaptureRecord> &records)
+{
+  FILE *file = fopen(path, "wb");
+  if (file == nullptr)
+  {
+    perror(path);
+    return false;
+  }
+  uint8_t buffer[halCaptureMaxRecord];
+  halCaptureHeader(buffer);
+  fwrite(buffer, 1, halCaptureHeaderSize, file);
+  unsigned long long previous = 0;
+  for (const halCaptureRecord &record : records)
+  {
+    fwrite(buffer, 1, halCaptureEncode(record, previous, buffer), file);
+    previous = record.time;
+  }
+  if (fclose(file) != 0)
+  {
+    perror(path);
+    return false;
+  }
+  return true;
+}
+
+// Runs the vehicle on a virtual clock and hands it the frames of the remote at the times they were received. A reset in the capture doesn't
+// reset the vehicle, its sessions run one after the other
+bool replay(const std::vector<halCaptureRecord> &records, const char *timelinePath, const char *eepromPath)
+{
+  FILE *timeline = fopen(timelinePath, "w");
+  if (timeline == nullptr)
+  {
+    perror(timelinePath);
+    return false;
+  }
+  fprintf(timeline, "ms,steering,motor,aux1,aux2\n");
+  halSelectBoard(halNewBoard()); // Nothing is written to disk
+  halUseVirtualClock();
+  halSetAir(&replayAir);
+  if (eepromPath)
+  {
+    FILE *file = fopen(eepromPath, "rb");
+    if (file == nullptr)
+    {
+      perror(eepromPath);
+      return false;
+    }
+    size_t length = fread(halEepromData(), 1, E2END + 1, file);
+    (void)length;
+    fclose(file);
+  }
+  else
+  {
+    vehicle::bindPackage standIn; // The vehicle listens to whatever comes, the address of the remote isn't in the capture
+    const uint8_t standInAddress[5] = {0x5A, 0x3C, 0x96, 0x0F, 0xC3};
+    memcpy(standIn.address, standInAddress, sizeof(standIn.address));
+    auto first = std::find_if(records.begin(), records.end(), [](const halCaptureRecord &record) { return !record.ack; });
+    standIn.channel = first != records.end() ? first->channel : 76;
+    standIn.hopBands = 0xFF;
+    EEPROM.put(vehicle::eepromBinding, standIn);
+  }
+  vehicle::setup();
+
+  unsigned long delivered = 0;
+  bool watchdogExpired = false;
+  unsigned long long end = records.empty() ? 0 : records.back().time + replayTail;
+  size_t next = 0;
+  while (halClockMicros() < end && !watchdogExpired)
+  {
+    while (next < records.size() && records[next].time <= halClockMicros())
+    {
+      if (!records[next].ack) // The ack payloads went to the remote
+      {
+        deliverRecord(records[next]);
+        delivered++;
+      }
+      next++;
+    }
+    vehicle::loop();
+    halAdvanceClock(loopMicros);
+    watchdogExpired = !recordOutputs(timeline);
+  }
+  fclose(timeline);
+  byte mode = vehicle::rxData.mode;
+  printf("Replayed %lu frames in %.3f s: %lu output changes, digest %08X, ends in %s mode%s\n", delivered, halClockMicros() / 1e6, outputChanges,
+         outputDigest, mode < 6 ? modeNames[mode] : "an unknown", watchdogExpired ? ", watchdog expired" : "");
+  return !watchdogExpired;
+}
+
+// Hands a frame to the radio of the vehicle on the address, channel and data rate it listens on, wherever the frame was received
+void deliverRecord(const halCaptureRecord &record)
+{
+  halFrame frame;
+  memset(&frame, 0, sizeof(frame));
+  const uint8_t *address = vehicle::bound.address;
+  if (vehicle::rxData.mode == vehicle::binding)
+    frame.address = vehicle::address[0];
+  else
+    for (int i = 4; i >= 0; i--) // LSB first, like the RF24 library
+      frame.address = frame.address << 8 | address[i];
+  frame.channel = vehicle::radio.getChannel();
+  frame.dataRate = vehicle::radio.getDataRate();
+  frame.pid = pid = (pid + 1) & 3;
+  frame.noAck = record.noAck;
+  frame.length = record.length;
+  memcpy(frame.payload, record.payload, record.length);
+  halFrame ack;
+  vehicle::radio.deliver(frame, &ack);
+}
+
+// Adds a line to the timeline when a servo output changed, and folds it into the digest. false when the watchdog of the vehicle expired
+bool recordOutputs(FILE *timeline)
+{
+  bool changed = false;
+  for (byte i = 0; i < sizeof(servoPins); i++)
+  {
+    int pulse = halServoMicros(servoPins[i]);
+    changed = changed || pulse != lastOutputs[i];
+    lastOutputs[i] = pulse;
+  }
+  if (changed)
+  {
+    char line[96];
+    int length = snprintf(line, sizeof(line), "%.3f,%i,%i,%i,%i\n", halClockMicros() / 1e3, lastOutputs[0], lastOutputs[1], lastOutputs[2],
+                          lastOutputs[3]);
+    fputs(line, timeline);
+    for (int i = 0; i < length; i++)
+      outputDigest = (outputDigest ^ (uint8_t)line[i]) * 16777619u;
+    outputChanges++;
+  }
+  return !halWatchdogExpired();
+}
+
+// Decodes the whole capture again and again: the records, their kinds and the validation of the packages
+void benchmark(const std::vector<uint8_t> &data)
+{
+  struct timespec started, now;
+  clock_gettime(CLOCK_MONOTONIC, &started);
+  unsigned long long records = 0, rounds = 0;
+  unsigned long valid = 0;
+  double seconds = 0;
+  do
+  {
+    halCaptureReader reader(data.data(), data.size());
+    halCaptureRecord record;
+    while (reader.next(&record))
+    {
+      records++;
+      if (frameKind(record) != kindPackage)
+        continue;
+      vehicle::dataPackage package;
+      memcpy(&package, record.payload, sizeof(package));
+      valid += vehicle::validateData(package);
+    }
+    rounds++;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    seconds = (now.tv_sec - started.tv_sec) + (now.tv_nsec - started.tv_nsec) / 1e9;
+  } while (seconds < benchmarkSeconds);
+  printf("Decoding: %.0f frames/s, %.1f MB/s, %.1f ns per frame (%llu rounds, %lu valid packages)\n", records / seconds,
+         data.size() * rounds / seconds / 1e6, seconds * 1e9 / max(records, 1ULL), rounds, valid);
+}
+
+// Nearest rank percentile, sorts the values
+unsigned long long percentile(std::vector<unsigned long long> &values, unsigned int percent)
+{
+  std::sort(values.begin(), values.end());
+  size_t rank = (values.size() * percent + 99) / 100;
+  return values[max(rank, (size_t)1) - 1];
+}
@@ -0,0 +1,244 @@
+/*  Benchmark of the latency from a stick of the remote to the steering pulse of the vehicle, on the simulation engine, see simulation.h.
+    The steering stick jumps between two positions a few times per second, at seeded random moments so the steps don't line up with the frames
+    of the remote. The latency of a step runs until the vehicle writes a new pulse width to the steering servo, the 20 ms period of the servo
+    signal comes on top. Every link profile runs at every loss rate, each case in its own process so it starts from a fresh boot of both programs.
+    The results are written as JSON: p50, p99 and max in us per case, and the steps that never reached the servo.
+
+    Usage: program [-n steps] [-r seed] [-o results.json]
+*/
+
+#include "simulation.h"
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+// Data types
+struct latencyProfile // Link of the model profile, one of the variations of the benchmark
+{
+  const char *name;
+  simulationLink link;
+};
+
+struct latencyLoss // Loss on the air, the other variation
+{
+  float loss;  // Chance that a frame is lost
+  float burst; // Frames per burst of losses on average, 0 = no bursts
+};
+
+struct latencyResult
+{
+  std::vector<unsigned long> samples; // us per step that reached the servo
+  unsigned int missed;                // Steps that didn't reach the servo before the next one
+  uint8_t dataRate;                   // rf24_datarate_e of the link at the end
+  bool watchdogExpired;
+};
+
+// Prototypes
+std::string runCase(const latencyProfile &profile, const latencyLoss &loss, unsigned int steps, unsigned long seed);
+latencyResult measureCase(const latencyProfile &profile, const latencyLoss &loss, unsigned int steps, unsigned long seed);
+void moveStick();
+unsigned long percentile(const std::vector<unsigned long> &sorted, unsigned int percent);
+const char *dataRateName(uint8_t dataRate);
+
+// Global variables
+const latencyProfile profiles[] = {
+    {"arq", {0, false}},         // The RF24 default: 15 retransmits 1.5 ms apart
+    {"arq-hopping", {0, true}},  // 3 retransmits 0.5 ms apart, a write fits in a frame
+    {"race-1", {1, false}},
+    {"race-2", {2, false}},
+    {"race-4", {4, false}}};
+const latencyLoss losses[] = {{0, 0}, {0.02f, 0}, {0.1f, 0}, {0.3f, 0}, {0.02f, 5}};
+const unsigned long long menuPress = 4000000;   // us, ack chooses easy mode in the menu after the startup screen
+const unsigned long long menuRelease = 4500000; // us
+const unsigned long long firstStep = 6000000;   // us, the vehicle has followed the remote into easy mode by then
+const unsigned long stepPeriod = 250000;        // us between the steps of the stick
+const unsigned long stepJitter = 10000;         // us, random extra delay of every step
+const int stepPositions[2] = {200, 850};        // Steering stick left and right of the center
+const simulationInput *steeringStick = nullptr;
+const simulationInput *ackButton = nullptr;
+std::minstd_rand stepRandom;
+unsigned long long nextStep = 0; // us, when the stick moves next
+unsigned long long stepTime = 0; // us, when the stick moved last, 0 = not yet
+unsigned int stepCount = 0;
+
+int main(int argc, char **argv)
+{
+  unsigned int steps = 200;
+  unsigned long seed = 1;
+  const char *resultsPath = nullptr;
+  int option;
+  while ((option = getopt(argc, argv, "n:r:o:")) != -1)
+  {
+    switch (option)
+    {
+    case 'n':
+      steps = max(atoi(optarg), 1);
+      break;
+    case 'r':
+      seed = strtoul(optarg, nullptr, 0);
+      break;
+    case 'o':
+      resultsPath = optarg;
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-n steps] [-r seed] [-o results.json]\n", argv[0]);
+      return 2;
+    }
+  }
+  steeringStick = simulationFindInput("leftX");
+  ackButton = simulationFindInput("ack");
+
+  std::string results;
+  for (const latencyProfile &profile : profiles)
+  {
+    for (const latencyLoss &loss : losses)
+    {
+      std::string result = runCase(profile, loss, steps, seed);
+      if (result.empty())
+        return 1;
+      results += results.empty() ? "\n    " : ",\n    ";
+      results += result;
+    }
+  }
+
+  FILE *file = resultsPath ? fopen(resultsPath, "w") : stdout;
+  if (file == nullptr)
+  {
+    perror(resultsPath);
+    return 1;
+  }
+  fprintf(file, "{\n  \"benchmark\": \"stick-to-pwm-latency\",\n  \"unit\": \"us\",\n  \"steps\": %u,\n  \"seed\": %lu,\n", steps, seed);
+  fprintf(file, "  \"framePeriod\": %u,\n  \"payloadSize\": %u,\n  \"results\": [%s\n  ]\n}\n", simulationFramePeriod, simulationPayloadSize,
+          results.c_str());
+  if (file != stdout)
+    fclose(file);
+  return 0;
+}
+
+// Runs one case in a child process, the programs keep their state in globals. Returns the case as a JSON object, empty when the child failed
+std::string runCase(const latencyProfile &profile, const latencyLoss &loss, unsigned int steps, unsigned long seed)
+{
+  int channel[2];
+  if (pipe(channel) != 0)
+  {
+    perror("pipe");
+    return "";
+  }
+  fflush(stdout);
+  pid_t child = fork();
+  if (child == 0)
+  {
+    close(channel[0]);
+    latencyResult result = measureCase(profile, loss, steps, seed);
+    uint8_t retryDelay, retryCount;
+    simulationRetries(profile.link, retryDelay, retryCount);
+    std::sort(result.samples.begin(), result.samples.end());
+    char json[512];
+    int length = snprintf(json, sizeof(json),
+                          "{\"link\": \"%s\", \"raceCopies\": %u, \"hopping\": %s, \"retryDelay\": %u, \"retryCount\": %u, \"dataRate\": \"%s\", "
+                          "\"loss\": %g, \"burst\": %g, \"samples\": %zu, \"missed\": %u, \"p50\": %lu, \"p99\": %lu, \"max\": %lu, \"watchdog\": %s}",
+                          profile.name, profile.link.raceCopies, profile.link.hopping ? "true" : "false",
+                          retryDelay, retryCount, dataRateName(result.dataRate), loss.loss, loss.burst, result.samples.size(), result.missed,
+                          percentile(result.samples, 50), percentile(result.samples, 99), percentile(result.samples, 100),
+                          result.watchdogExpired ? "true" : "false");
+    bool written = write(channel[1], json, length) == length;
+    _exit(written ? 0 : 1); // Skips the destructors and the EEPROM file of the Linux backend
+  }
+  close(channel[1]);
+  std::string result;
+  char buffer[256];
+  ssize_t length;
+  while ((length = read(channel[0], buffer, sizeof(buffer))) > 0)
+    result.append(buffer, length);
+  close(channel[0]);
+  int status;
+  if (child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+  {
+    fprintf(stderr, "Case %s at loss %g failed\n", profile.name, loss.loss);
+    return "";
+  }
+  fprintf(stderr, "%s\n", result.c_str());
+  return result;
+}
+
+// Drives the remote into easy mode and moves the steering stick, then measures every step at the steering servo of the vehicle
+latencyResult measureCase(const latencyProfile &profile, const latencyLoss &loss, unsigned int steps, unsigned long seed)
+{
+  latencyResult result = {{}, 0, 0, false};
+  simulationAir.model.seed = seed;
+  simulationAir.model.loss = loss.loss;
+  if (loss.burst > 0)
+  {
+    simulationAir.model.goodToBad = 0.01f;
+    simulationAir.model.badToGood = 1 / loss.burst;
+  }
+  stepRandom.seed(seed);
+  nextStep = firstStep;
+  simulationBegin(true, profile.link);
+  simulationOnRemote(moveStick);
+
+  unsigned long long current = 0; // us, step that is measured
+  bool reached = false;            // The current step reached the servo
+  while (stepCount <= steps)
+  {
+    if (simulationStep() != simulationVehicle)
+      continue;
+    if (halWatchdogExpired())
+    {
+      result.watchdogExpired = true;
+      break;
+    }
+    unsigned long long changed = halServoChanged(simulationSteering);
+    if (current != 0 && !reached && changed >= current)
+    {
+      result.samples.push_back(changed - current);
+      reached = true;
+    }
+    if (stepTime == current) // The stick didn't move since the last look
+      continue;
+    if (current != 0 && !reached) // The stick moved again before the last step reached the servo
+      result.missed++;
+    current = stepTime;
+    reached = false;
+  }
+  result.dataRate = simulationDataRate();
+  return result;
+}
+
+// Presses the buttons and moves the stick of the remote, called whenever the clock of the remote moves
+void moveStick()
+{
+  unsigned long long now = halClockMicros();
+  simulationSetInput(*ackButton, now >= menuPress && now < menuRelease);
+  if (now < nextStep)
+    return;
+  simulationSetInput(*steeringStick, stepPositions[stepCount % 2]);
+  stepTime = now;
+  stepCount++;
+  nextStep += stepPeriod + stepRandom() % stepJitter;
+}
+
+// Nearest rank percentile of sorted samples, 0 without samples
+unsigned long percentile(const std::vector<unsigned long> &sorted, unsigned int percent)
+{
+  if (sorted.empty())
+    return 0;
+  size_t rank = (sorted.size() * percent + 99) / 100;
+  return sorted[max(rank, (size_t)1) - 1];
+}
+
+const char *dataRateName(uint8_t dataRate)
+{
+  switch (dataRate)
+  {
+  case RF24_1MBPS:
+    return "1Mbps";
+  case RF24_2MBPS:
+    return "2Mbps";
+  default:
+    return "250kbps";
+  }
+}
@@ -0,0 +1,242 @@
+/*  Simulation of the remote and the vehicle together, on a virtual clock. Both programs run unchanged in one process and talk over the
+    simulated air, see simulation.h. A script moves the sticks and presses the buttons of the remote, the pulses on the servo outputs of the
+    vehicle are written to a timeline. An hour of driving takes seconds.
+    The vehicle starts bound to the first model profile of the remote, unless -n asks for a new vehicle that the script has to bind.
+
+    Usage: program [-t minutes] [-s script] [-o timeline.csv] [-l loss] [-b burst] [-r seed] [-q quantum] [-c copies] [-f] [-n]
+*/
+
+#include "simulation.h"
+#include <unistd.h>
+#include <time.h>
+#include <vector>
+
+// Data types
+struct scriptEvent // One line of the script
+{
+  unsigned long long time; // us since the start, or since the start of the round in the repeated part
+  const simulationInput *input;
+  int value;
+};
+
+// Prototypes
+void loadScript(const char *path);
+void parseScript(FILE *file);
+void applyScript();
+void recordOutputs(FILE *timeline, unsigned long long time);
+void printSummary(double wallSeconds);
+
+// Global variables
+const char *const defaultScript = // Picks easy mode in the menu, then drives laps: throttle, a turn, brake, lights and horn
+    "4.0 ack 1\n4.5 ack 0\n"
+    "repeat\n"
+    "0 rightY 512\n0 leftX 512\n"
+    "1 rightY 900\n3 leftX 200\n4 leftX 512\n5 leftX 850\n6 leftX 512\n"
+    "8 rightY 100\n9 rightY 512\n"
+    "10 aux1 1\n10.2 aux1 0\n"
+    "12 rightY 700\n14 aux2 1\n14.3 aux2 0\n16 rightY 512\n"
+    "20 rightY 512\n";
+std::vector<scriptEvent> startEvents; // Run once
+std::vector<scriptEvent> roundEvents; // Repeat until the end of the simulation
+unsigned long long roundLength = 0;   // us of one round of the repeated part
+size_t nextStart = 0;                 // Next event of startEvents
+size_t nextRound = 0;                 // Next event of roundEvents
+unsigned long long roundStart = 0;    // us, start of the current round
+int lastOutputs[simulationOutputCount];
+unsigned long outputChanges = 0;
+bool watchdogExpired = false;
+
+int main(int argc, char **argv)
+{
+  double minutes = 60;
+  const char *scriptPath = nullptr;
+  const char *timelinePath = nullptr;
+  bool bound = true;
+  simulationLink link;
+  int option;
+  while ((option = getopt(argc, argv, "t:s:o:l:b:r:q:c:fn")) != -1)
+  {
+    switch (option)
+    {
+    case 't':
+      minutes = atof(optarg);
+      break;
+    case 's':
+      scriptPath = optarg;
+      break;
+    case 'o':
+      timelinePath = optarg;
+      break;
+    case 'l':
+      simulationAir.model.loss = atof(optarg);
+      break;
+    case 'b': // Bursts of lost frames, about one per second at 100 frames per second, this many frames long on average
+      simulationAir.model.goodToBad = 0.01f;
+      simulationAir.model.badToGood = 1 / max(atof(optarg), 1.0);
+      break;
+    case 'r':
+      simulationAir.model.seed = strtoul(optarg, nullptr, 0);
+      break;
+    case 'q':
+      simulationQuantum = strtoull(optarg, nullptr, 0);
+      break;
+    case 'c':
+      link.raceCopies = constrain(atoi(optarg), 0, 4);
+      break;
+    case 'f':
+      link.hopping = true;
+      break;
+    case 'n':
+      bound = false;
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-t minutes] [-s script] [-o timeline.csv] [-l loss] [-b burst] [-r seed] [-q quantum] [-c copies] [-f] [-n]\n", argv[0]);
+      return 2;
+    }
+  }
+  loadScript(scriptPath);
+  FILE *timeline = timelinePath ? fopen(timelinePath, "w") : nullptr;
+  if (timelinePath && timeline == nullptr)
+  {
+    perror(timelinePath);
+    return 1;
+  }
+  if (timeline)
+    fprintf(timeline, "ms,steering,motor,aux1,aux2\n");
+
+  simulationBegin(bound, link);
+  simulationOnRemote(applyScript);
+  unsigned long long end = (unsigned long long)(minutes * 60e6);
+  struct timespec started, finished;
+  clock_gettime(CLOCK_MONOTONIC, &started);
+  while (simulationTime() < end)
+  {
+    if (simulationStep() != simulationVehicle)
+      continue;
+    recordOutputs(timeline, halClockMicros());
+    if (halWatchdogExpired())
+    {
+      fprintf(stderr, "Watchdog of the vehicle expired at %.3f s\n", halClockMicros() / 1e6);
+      watchdogExpired = true;
+      break;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &finished);
+  if (timeline)
+    fclose(timeline);
+  printSummary((finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9);
+  return watchdogExpired ? 1 : 0;
+}
+
+// Reads the script, or takes the default one. A line is "<seconds> <input> <value>", after a line "repeat" the lines repeat in rounds
+void loadScript(const char *path)
+{
+  FILE *file = path ? fopen(path, "r") : fmemopen((void *)defaultScript, strlen(defaultScript), "r");
+  if (file == nullptr)
+  {
+    perror(path);
+    exit(1);
+  }
+  parseScript(file);
+  fclose(file);
+}
+
+void parseScript(FILE *file)
+{
+  char line[128];
+  int lineNumber = 0;
+  bool repeating = false;
+  while (fgets(line, sizeof(line), file))
+  {
+    lineNumber++;
+    char *comment = strchr(line, '#');
+    if (comment)
+      *comment = '\0';
+    double seconds;
+    char name[32];
+    int value;
+    char word[32];
+    if (sscanf(line, " %31s", word) != 1) // Empty line
+      continue;
+    if (strcmp(word, "repeat") == 0)
+    {
+      repeating = true;
+      continue;
+    }
+    if (sscanf(line, "%lf %31s %d", &seconds, name, &value) != 3)
+    {
+      fprintf(stderr, "Script line %i: expected <seconds> <input> <value>\n", lineNumber);
+      exit(1);
+    }
+    const simulationInput *input = simulationFindInput(name);
+    if (input == nullptr)
+    {
+      fprintf(stderr, "Script line %i: unknown input %s\n", lineNumber, name);
+      exit(1);
+    }
+    scriptEvent event = {(unsigned long long)(seconds * 1e6), input, value};
+    if (repeating)
+    {
+      roundEvents.push_back(event);
+      roundLength = max(roundLength, event.time);
+    }
+    else
+      startEvents.push_back(event);
+  }
+  if (!roundEvents.empty() && roundLength == 0)
+  {
+    fprintf(stderr, "Script: the repeated part must last longer than 0 s\n");
+    exit(1);
+  }
+  if (!startEvents.empty())
+    roundStart = startEvents.back().time;
+}
+
+// Sets the inputs of the remote that the script changes up to now, called whenever the clock of the remote moves
+void applyScript()
+{
+  unsigned long long now = halClockMicros();
+  while (nextStart < startEvents.size() && startEvents[nextStart].time <= now)
+  {
+    simulationSetInput(*startEvents[nextStart].input, startEvents[nextStart].value);
+    nextStart++;
+  }
+  if (nextStart < startEvents.size() || roundEvents.empty())
+    return;
+  while (roundStart + roundEvents[nextRound].time <= now)
+  {
+    simulationSetInput(*roundEvents[nextRound].input, roundEvents[nextRound].value);
+    if (++nextRound == roundEvents.size())
+    {
+      nextRound = 0;
+      roundStart += roundLength;
+    }
+  }
+}
+
+// Counts the changes of the servo outputs of the vehicle and adds them to the timeline, the board of the vehicle is selected
+void recordOutputs(FILE *timeline, unsigned long long time)
+{
+  bool changed = false;
+  for (byte i = 0; i < simulationOutputCount; i++)
+  {
+    int pulse = halServoMicros(simulationOutputs[i]);
+    changed = changed || pulse != lastOutputs[i];
+    lastOutputs[i] = pulse;
+  }
+  if (!changed)
+    return;
+  outputChanges++;
+  if (timeline)
+    fprintf(timeline, "%.3f,%i,%i,%i,%i\n", time / 1e3, lastOutputs[0], lastOutputs[1], lastOutputs[2], lastOutputs[3]);
+}
+
+void printSummary(double wallSeconds)
+{
+  double simulated = simulationTime() / 1e6;
+  const halLinkStats &stats = simulationAir.stats;
+  printf("Simulated %.1f s in %.2f s, %.0f times real time\n", simulated, wallSeconds, simulated / max(wallSeconds, 1e-9));
+  printf("Frames on the air: %lu, delivered %lu, lost %lu + %lu in bursts, acknowledgements lost %lu\n", stats.frames, stats.delivered,
+         stats.lost, stats.burstLost, stats.acksLost);
+  printf("Vehicle: lost frames %u %%, output changes %lu%s\n", simulationLostFrames(), outputChanges, watchdogExpired ? ", watchdog expired" : "");
+}
@@ -0,0 +1,211 @@
+// Engine of the simulations, with both programs compiled in
+#undef _FORTIFY_SOURCE // Its longjmp() refuses to jump to the stack of another program
+#include <Arduino.h>
+#include <LibPrintf.h>
+#include <EEPROM.h>
+#include <Servo.h>
+#include <SPI.h>
+#include <U8g2lib.h>
+#include <hal.h>
+#include <hal_display.h>
+#include <nRF24L01.h>
+#include <nRF24l01.h>
+#include <RF24.h>
+#include "simulation.h"
+#include <ucontext.h>
+#include <setjmp.h>
+#include <vector>
+
+// The programs, each in its own namespace. The headers above are already included, so their includes do nothing here
+namespace remote
+{
+#include "../../RC car sender on Teensy LC/src/main.cpp"
+}
+
+namespace vehicle
+{
+#include "../../RC car receiver on Pro Mini/src/main.cpp"
+}
+
+// Data types
+struct program // One of the simulated microcontrollers
+{
+  void (*setup)();
+  void (*loop)();
+  unsigned int loopMicros;  // us one pass of loop() takes, besides the time of delays, the buses and the air
+  halBoard *board;
+  ucontext_t context;       // Starts the program on its own stack
+  jmp_buf resume;           // Where the program continues after it handed over
+  bool started;
+  std::vector<char> stack;
+  unsigned long long time;  // us, virtual clock of the board when it last stopped
+};
+
+// Prototypes
+void runProgram();
+void yieldProgram();
+void storeProfiles(const simulationLink &link);
+void bindVehicle();
+
+// Global variables
+const size_t stackSize = 256 * 1024; // Bytes of stack per program
+const simulationInput simulationInputs[] = {
+    {"rightX", remote::rightX, false},
+    {"rightY", remote::rightY, false},
+    {"leftX", remote::leftX, false},
+    {"leftY", remote::leftY, false},
+    {"battery", remote::batteryValue, false},
+    {"rightButton", remote::rightJoystickButton, true},
+    {"leftButton", remote::leftJoystickButton, true},
+    {"back", remote::backButton, true},
+    {"ack", remote::ackButton, true},
+    {"aux1", remote::auxButton1, true},
+    {"aux2", remote::auxButton2, true}};
+const uint8_t simulationInputCount = sizeof(simulationInputs) / sizeof(simulationInputs[0]);
+const uint8_t simulationOutputs[simulationOutputCount] = {simulationSteering, 3, vehicle::aux1Pin, vehicle::aux2Pin};
+halSimAir simulationAir;
+unsigned long long simulationQuantum = 200;
+const uint8_t simulationFramePeriod = remote::framePeriod;
+const uint8_t simulationPayloadSize = sizeof(remote::dataPackage);
+program programs[2] = {
+    {remote::setup, remote::loop, 100, nullptr, {}, {}, false, {}, 0},
+    {vehicle::setup, vehicle::loop, 250, nullptr, {}, {}, false, {}, 0}};
+program *running = nullptr;      // Program whose context runs right now, nullptr = the scheduler
+jmp_buf scheduler;               // Where the scheduler continues when a program hands over
+void (*remoteHook)() = nullptr;
+
+void simulationBegin(bool bound, const simulationLink &link)
+{
+  simulationAir.reset();
+  halSetAir(&simulationAir);
+  halSetYield(yieldProgram);
+  for (program &p : programs)
+  {
+    p.board = halNewBoard();
+    halSelectBoard(p.board);
+    halUseVirtualClock();
+    p.stack.resize(stackSize);
+    getcontext(&p.context);
+    p.context.uc_stack.ss_sp = p.stack.data();
+    p.context.uc_stack.ss_size = p.stack.size();
+    makecontext(&p.context, runProgram, 0);
+  }
+  vehicle::radio.spiSpeed = 4000000; // The Pro Mini at 8 MHz runs SPI at half its clock at most
+  storeProfiles(link);
+  if (bound)
+    bindVehicle();
+}
+
+void simulationOnRemote(void (*hook)())
+{
+  remoteHook = hook;
+}
+
+uint8_t simulationStep()
+{
+  program *next = programs[0].time <= programs[1].time ? &programs[0] : &programs[1];
+  halSelectBoard(next->board);
+  running = next;
+  if (_setjmp(scheduler) == 0) // The first time through makecontext(), then with a jump that doesn't touch the signal mask like swapcontext()
+  {
+    if (next->started)
+      _longjmp(next->resume, 1);
+    next->started = true;
+    setcontext(&next->context);
+  }
+  running = nullptr;
+  next->time = halClockMicros();
+  return next - programs;
+}
+
+unsigned long long simulationTime()
+{
+  return min(programs[0].time, programs[1].time);
+}
+
+const simulationInput *simulationFindInput(const char *name)
+{
+  for (const simulationInput &input : simulationInputs)
+  {
+    if (strcmp(input.name, name) == 0)
+      return &input;
+  }
+  return nullptr;
+}
+
+void simulationSetInput(const simulationInput &input, int value)
+{
+  if (input.digital) // Buttons are pulled up, pressed = LOW
+    halSetDigital(input.pin, value ? LOW : HIGH);
+  else
+    halSetAnalog(input.pin, value);
+}
+
+uint8_t simulationDataRate()
+{
+  return remote::radio.getDataRate();
+}
+
+uint8_t simulationLostFrames()
+{
+  return vehicle::telemetry.lostFrames;
+}
+
+void simulationRetries(const simulationLink &link, uint8_t &delay, uint8_t &count)
+{
+  bool hopping = link.raceCopies == 0 && link.hopping; // The race link has no retransmits, it keeps the default
+  delay = hopping ? remote::hopRetryDelay : remote::arqRetryDelay;
+  count = hopping ? remote::hopRetryCount : remote::arqRetryCount;
+}
+
+// Entry of the context of a program, runs it like the Arduino core does
+void runProgram()
+{
+  program *self = running;
+  self->setup();
+  while (true)
+  {
+    self->loop();
+    halAdvanceClock(self->loopMicros);
+  }
+}
+
+// Called by the backend whenever virtual time passes. Hands over to the scheduler once the program is a quantum ahead of the other one
+void yieldProgram()
+{
+  if (running == nullptr)
+    return;
+  if (running == &programs[simulationRemote] && remoteHook)
+    remoteHook();
+  program *other = running == &programs[0] ? &programs[1] : &programs[0];
+  if (halClockMicros() <= other->time + simulationQuantum)
+    return;
+  if (_setjmp(running->resume) == 0)
+    _longjmp(scheduler, 1);
+}
+
+// Stores model profiles with this link in the EEPROM of the remote, like loadProfiles() creates them
+void storeProfiles(const simulationLink &link)
+{
+  remote::modelProfile profile;
+  profile.raceCopies = link.raceCopies;
+  profile.hopping = link.hopping;
+  halSelectBoard(programs[simulationRemote].board);
+  for (byte i = 0; i < remote::profileCount; i++)
+    EEPROM.put(remote::profileAddress(i), profile);
+  EEPROM.write(remote::eepromActiveProfile, 0);
+  EEPROM.write(remote::eepromProfileSize, sizeof(remote::modelProfile));
+  EEPROM.write(remote::eepromMagic, remote::profileMagic);
+}
+
+// Stores the binding to the first model profile in the EEPROM of the vehicle, as if it had been bound before
+void bindVehicle()
+{
+  remote::modelProfile profile;
+  vehicle::bindPackage binding;
+  memcpy(binding.address, profile.address, sizeof(binding.address));
+  binding.channel = profile.channel;
+  binding.hopBands = profile.hopBands;
+  halSelectBoard(programs[simulationVehicle].board);
+  EEPROM.put(vehicle::eepromBinding, binding);
+}
@@ -0,0 +1,46 @@
+/*  Engine of the simulations: the remote and the vehicle in one process, on a virtual clock and the simulated air. Both programs run unchanged,
+    each on its own board of the Linux backend, as coroutines on one core. A program runs until its clock is more than a quantum ahead of the
+    other one, then the other catches up. Time passes in delay(), when reading the clock, on the SPI bus of the radio, on the air, on the I2C
+    bus of the display and with every pass of loop().
+*/
+
+#pragma once
+#include <Arduino.h>
+#include <hal_linux.h>
+#include <hal_sim_air.h>
+
+struct simulationLink // Link of the model profile the remote drives the vehicle with
+{
+  uint8_t raceCopies = 0;  // 0 = ARQ link with retransmits, 1...4 = race link with this many copies of every package
+  bool hopping = false;    // Frequency hopping, the remote sets the retransmits of the ARQ link by it
+};
+
+struct simulationInput // Input of the remote a simulation can set
+{
+  const char *name;
+  uint8_t pin;
+  bool digital; // Button with pull-up, pressed = LOW
+};
+
+const uint8_t simulationRemote = 0; // Programs
+const uint8_t simulationVehicle = 1;
+const uint8_t simulationOutputCount = 4;
+const uint8_t simulationSteering = 5; // Servo pin of the steering of the vehicle
+
+extern const simulationInput simulationInputs[];
+extern const uint8_t simulationInputCount;
+extern const uint8_t simulationOutputs[simulationOutputCount]; // Servo pins of the vehicle: steering, motor and the extra outputs of the mixer
+extern halSimAir simulationAir;                                // Its model is set before simulationBegin()
+extern unsigned long long simulationQuantum;                   // us a program may run ahead of the other one, the error of the timing between them
+extern const uint8_t simulationFramePeriod;                    // ms between packages of the remote while driving, fixed in the programs
+extern const uint8_t simulationPayloadSize;                    // Bytes of a package of the remote, fixed in the programs
+
+void simulationBegin(bool bound, const simulationLink &link); // Creates the boards. bound = the vehicle starts bound to the first model profile
+void simulationOnRemote(void (*hook)());                      // Called whenever the clock of the remote moves, with its board selected. For inputs at an exact time
+uint8_t simulationStep();                                     // Runs the program that is behind for a quantum, returns which one. Its board stays selected
+unsigned long long simulationTime();                          // us, both programs have come this far
+const simulationInput *simulationFindInput(const char *name);
+void simulationSetInput(const simulationInput &input, int value); // 0...1023, or 1 = pressed for a button. The board of the remote is selected
+uint8_t simulationDataRate();                                 // rf24_datarate_e the remote sends with right now
+uint8_t simulationLostFrames();                               // 0...100 %, packages of the remote that didn't arrive, from the telemetry of the vehicle
+void simulationRetries(const simulationLink &link, uint8_t &delay, uint8_t &count); // Retransmit delay (x250 us) and count the remote sets for the ARQ link
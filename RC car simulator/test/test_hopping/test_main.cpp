@@ -0,0 +1,69 @@
+/*  The remote and the vehicle hopping together in the simulation, on an air without loss. The remote picks easy mode in the menu and drives
+    with the display drawing between the frames, the vehicle has to stay in step with the hop sequence: every frame after the start arrives,
+    none is sent to a channel the vehicle already left.
+
+    Run with: pio test -e test -f test_hopping
+*/
+
+#include <unity.h>
+#include "simulation.h"
+
+const unsigned long long menuPress = 4000000;   // us, picks easy mode in the menu, like the default script of the simulation
+const unsigned long long menuRelease = 4500000;
+const unsigned long long settleTime = 10000000; // us, the vehicle has synced to the hop sequence
+const unsigned long long driveTime = 60000000;  // us that are measured
+const simulationInput *ackButton = nullptr;
+
+// Presses the ack button of the remote once, called whenever the clock of the remote moves
+void pickEasyMode()
+{
+  unsigned long long now = halClockMicros();
+  simulationSetInput(*ackButton, now >= menuPress && now < menuRelease);
+}
+
+// Runs both programs until the simulated time
+void runUntil(unsigned long long end)
+{
+  while (simulationTime() < end)
+  {
+    simulationStep();
+    TEST_ASSERT_FALSE_MESSAGE(halWatchdogExpired(), "the watchdog of the vehicle expired");
+  }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_hopping_stays_in_step()
+{
+  simulationLink link;
+  link.hopping = true;
+  ackButton = simulationFindInput("ack");
+  simulationBegin(true, link);
+  simulationOnRemote(pickEasyMode);
+
+  runUntil(settleTime);
+  halLinkStats start = simulationAir.stats;
+  runUntil(settleTime + driveTime);
+  unsigned long frames = simulationAir.stats.frames - start.frames;
+  unsigned long delivered = simulationAir.stats.delivered - start.delivered;
+  char message[96];
+  snprintf(message, sizeof(message), "%lu of %lu frames delivered", delivered, frames);
+  TEST_ASSERT_GREATER_THAN_UINT32_MESSAGE(driveTime / simulationFramePeriod / 1000 * 9 / 10, frames, "the remote didn't drive");
+  TEST_ASSERT_UINT32_WITHIN_MESSAGE(frames / 100, frames, delivered, message); // A retransmit means the vehicle listened on another channel
+  TEST_ASSERT_LESS_OR_EQUAL_UINT8_MESSAGE(1, simulationLostFrames(), "lost frames in % of the telemetry of the vehicle");
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_hopping_stays_in_step);
+  return UNITY_END();
+}
@@ -0,0 +1,129 @@
+/*  Linux backend of the Arduino API, only the parts the sender and the receiver use.
+    Time runs from the start of the process, pins and analog inputs are plain variables that hal_linux.h gives access to.
+*/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <type_traits>
+#include "Print.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+// Analog inputs, numbered like on the Pro Mini and the Teensy LC
+const uint8_t A0 = 14;
+const uint8_t A1 = 15;
+const uint8_t A2 = 16;
+const uint8_t A3 = 17;
+const uint8_t A4 = 18;
+const uint8_t A5 = 19;
+const uint8_t A6 = 20;
+const uint8_t A7 = 21;
+const uint8_t halPinCount = 64;
+
+#define PROGMEM
+#define F(text) (text)
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define _BV(bit) (1 << (bit))
+
+// min() and max() for mixed types, like the Teensy core
+template <class A, class B>
+auto min(const A &a, const B &b) -> decltype(a < b ? a : b)
+{
+  return b < a ? b : a;
+}
+template <class A, class B>
+auto max(const A &a, const B &b) -> decltype(a < b ? a : b)
+{
+  return a < b ? b : a;
+}
+
+// Clock
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+// GPIO and ADC
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration = 0);
+void noTone(uint8_t pin);
+
+// Math
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+
+// Arduino String, only concatenation and c_str()
+class String
+{
+public:
+  String(const char *text = "") : text(text ? text : "") {}
+  String(const std::string &text) : text(text) {}
+  String(char c) : text(1, c) {}
+  template <class T, typename std::enable_if<std::is_arithmetic<T>::value, int>::type = 0>
+  String(T value) : text(number(value)) {}
+  const char *c_str() const { return text.c_str(); }
+  unsigned int length() const { return text.length(); }
+  String &operator+=(const String &other)
+  {
+    text += other.text;
+    return *this;
+  }
+  friend String operator+(const String &a, const String &b) { return String(a.text + b.text); }
+  friend String operator+(const String &a, const char *b) { return String(a.text + b); }
+  friend String operator+(const String &a, char b) { return String(a.text + b); }
+  template <class T, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, char>::value, int>::type = 0>
+  friend String operator+(const String &a, T b) { return String(a.text + number(b)); }
+
+private:
+  template <class T>
+  static std::string number(T value)
+  {
+    if (std::is_floating_point<T>::value)
+    {
+      char buffer[32];
+      snprintf(buffer, sizeof(buffer), "%.2f", (double)value);
+      return buffer;
+    }
+    return std::to_string(value);
+  }
+  std::string text;
+};
+
+inline size_t Print::print(const String &text) { return print(text.c_str()); }
+inline size_t Print::println(const String &text) { return println(text.c_str()); }
+
+// Serial monitor on stdin and stdout
+class HardwareSerial : public Print
+{
+public:
+  void begin(unsigned long baud);
+  int available();
+  int read();
+  int availableForWrite() { return 64; } // stdout doesn't fill up, like an empty transmit buffer of the Pro Mini
+  size_t write(uint8_t c) override;
+  using Print::write;
+};
+extern HardwareSerial Serial;
+
+// The program
+void setup();
+void loop();
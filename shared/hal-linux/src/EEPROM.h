@@ -0,0 +1,31 @@
+// Linux backend of the EEPROM library. Kept in memory, and in the file named by HAL_EEPROM when it is set. E2END is set by the build
+#pragma once
+#include <Arduino.h>
+
+#ifndef E2END
+#define E2END 1023
+#endif
+
+class EEPROMClass
+{
+public:
+  uint8_t read(int address);
+  void write(int address, uint8_t value);
+  void update(int address, uint8_t value);
+  uint16_t length() { return E2END + 1; }
+  template <class T>
+  T &get(int address, T &value)
+  {
+    for (size_t i = 0; i < sizeof(T); i++)
+      ((uint8_t *)&value)[i] = read(address + i);
+    return value;
+  }
+  template <class T>
+  const T &put(int address, const T &value)
+  {
+    for (size_t i = 0; i < sizeof(T); i++)
+      update(address + i, ((const uint8_t *)&value)[i]);
+    return value;
+  }
+};
+extern EEPROMClass EEPROM;
@@ -0,0 +1,3 @@
+// Linux backend: printf() of the C library already writes to the terminal
+#pragma once
+#include <stdio.h>
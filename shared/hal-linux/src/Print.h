@@ -0,0 +1,44 @@
+// Linux backend of the Arduino Print class, used by the Serial monitor and the display
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+class String;
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size)
+  {
+    size_t n = 0;
+    while (size--)
+      n += write(*buffer++);
+    return n;
+  }
+  size_t write(const char *text) { return text ? write((const uint8_t *)text, strlen(text)) : 0; }
+  size_t print(const char *text) { return write(text); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(const String &text);
+  size_t print(int value) { return print((long)value); }
+  size_t print(unsigned int value) { return print((unsigned long)value); }
+  size_t print(long value) { return printFormatted("%ld", value); }
+  size_t print(unsigned long value) { return printFormatted("%lu", value); }
+  size_t print(double value) { return printFormatted("%.2f", value); }
+  size_t println() { return write("\r\n"); }
+  size_t println(const char *text) { return print(text) + println(); }
+  size_t println(const String &text);
+  template <class T>
+  size_t println(T value) { return print(value) + println(); }
+
+private:
+  template <class T>
+  size_t printFormatted(const char *format, T value)
+  {
+    char buffer[32];
+    int length = snprintf(buffer, sizeof(buffer), format, value);
+    return write((const uint8_t *)buffer, length);
+  }
+};
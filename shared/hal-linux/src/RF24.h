@@ -0,0 +1,151 @@
+/*  Linux backend of the RF24 library, the calls of the sender and the receiver. The radios send their frames on a halAir medium, by default
+    on the air between processes: every process with a radio joins the directory named by HAL_AIR (/tmp/rc-car-air when not set).
+    Radios in the same process hear each other directly. Auto acknowledgement, ack payloads, retransmits and the 3 deep FIFOs work like on the nRF24L01+.
+    On the virtual clock every call takes the time of its bytes on the SPI bus. HAL_CAPTURE records the received frames, see hal_capture.h.
+*/
+
+#pragma once
+#include <Arduino.h>
+#include <mutex>
+
+typedef enum
+{
+  RF24_PA_MIN = 0,
+  RF24_PA_LOW,
+  RF24_PA_HIGH,
+  RF24_PA_MAX,
+  RF24_PA_ERROR
+} rf24_pa_dbm_e;
+
+typedef enum
+{
+  RF24_1MBPS = 0,
+  RF24_2MBPS,
+  RF24_250KBPS
+} rf24_datarate_e;
+
+typedef enum
+{
+  RF24_CRC_DISABLED = 0,
+  RF24_CRC_8,
+  RF24_CRC_16
+} rf24_crclength_e;
+
+#define RF24_SPI_SPEED 10000000 // Hz, default clock of the SPI bus, the fastest the nRF24L01+ allows
+
+struct halFrame // One frame on the air
+{
+  uint64_t address;    // Of the receiving pipe, 5 bytes
+  uint8_t channel;     // 0...125
+  uint8_t dataRate;    // rf24_datarate_e
+  uint8_t paLevel;     // rf24_pa_dbm_e of the sender
+  uint8_t pid;         // 0...3, tells a retransmit apart from a new package
+  bool noAck;          // The sender doesn't wait for an acknowledgement
+  uint8_t length;      // 0...32
+  uint8_t payload[32];
+};
+
+class RF24;
+
+class halAir // Medium the radios send on
+{
+public:
+  virtual ~halAir() {}
+  virtual void join(RF24 *radio) = 0;  // Called by begin()
+  virtual void leave(RF24 *radio) = 0;
+  // Sends one attempt of a frame. Returns true when a radio acknowledged it, ack then holds the acknowledgement and its payload.
+  // Also takes the time of the attempt, including the wait for the acknowledgement
+  virtual bool transmit(RF24 *sender, const halFrame &frame, halFrame *ack) = 0;
+  virtual bool carrier(uint8_t channel) = 0; // A signal stronger than -64 dBm on the channel, for testRPD()
+};
+
+halAir *halDefaultAir();        // Air between processes
+void halSetAir(halAir *air);    // Medium of the radios that begin() after this call, nullptr = halDefaultAir()
+
+class RF24
+{
+public:
+  RF24(uint16_t cePin, uint16_t csnPin, uint32_t spiSpeed = RF24_SPI_SPEED);
+  ~RF24();
+  bool begin();
+  bool isChipConnected() { return true; }
+  void startListening();
+  void stopListening();
+  bool available();
+  bool available(uint8_t *pipe);
+  void read(void *buffer, uint8_t length);
+  bool write(const void *buffer, uint8_t length);
+  bool write(const void *buffer, uint8_t length, bool multicast);
+  bool writeFast(const void *buffer, uint8_t length);
+  bool writeFast(const void *buffer, uint8_t length, bool multicast);
+  bool txStandBy() { return true; }
+  bool writeAckPayload(uint8_t pipe, const void *buffer, uint8_t length);
+  void openWritingPipe(const uint8_t *address);
+  void openWritingPipe(uint64_t address);
+  void openReadingPipe(uint8_t pipe, const uint8_t *address);
+  void openReadingPipe(uint8_t pipe, uint64_t address);
+  void closeReadingPipe(uint8_t pipe);
+  void setChannel(uint8_t channel);
+  uint8_t getChannel();
+  void setPALevel(uint8_t level, bool lnaEnable = true);
+  uint8_t getPALevel();
+  bool setDataRate(rf24_datarate_e speed);
+  rf24_datarate_e getDataRate();
+  void setAutoAck(bool enable);
+  void setAutoAck(uint8_t pipe, bool enable);
+  void enableAckPayload();
+  void enableDynamicPayloads();
+  void disableDynamicPayloads();
+  void setPayloadSize(uint8_t size);
+  uint8_t getDynamicPayloadSize();
+  void setRetries(uint8_t delay, uint8_t count);
+  void setCRCLength(rf24_crclength_e length) {}
+  void setAddressWidth(uint8_t width) {}
+  uint8_t getARC();
+  bool testRPD();
+  bool testCarrier() { return testRPD(); }
+  uint8_t flush_rx();
+  uint8_t flush_tx();
+  void powerUp() {}
+  void powerDown() {}
+
+  // Used by the halAir media
+  bool deliver(const halFrame &frame, halFrame *ack); // A frame arrives, returns true when the radio acknowledges it
+  bool listening();
+  uint8_t retryDelay();                              // ARD, 0...15, x250 us + 250 us between the attempts
+  halAir *air = nullptr;                             // Medium of this radio, set by begin()
+  uint32_t spiSpeed;                                 // Hz, clock of the SPI bus. A microcontroller may run it slower than asked
+
+private:
+  struct fifoEntry
+  {
+    uint8_t pipe;
+    uint8_t length;
+    uint8_t payload[32];
+  };
+  void spi(uint8_t bytes);   // The command byte and this many bytes on the SPI bus
+  std::recursive_mutex lock; // The air between processes delivers frames from its own thread
+  bool isListening = false;
+  uint8_t channel = 76;
+  uint8_t paLevel = RF24_PA_MAX;
+  uint8_t dataRate = RF24_1MBPS;
+  uint8_t autoAck = 0x3F;      // Bit per pipe
+  bool ackPayloads = false;
+  bool dynamicPayloads = false;
+  uint8_t payloadSize = 32;
+  uint8_t retriesDelay = 5;
+  uint8_t retriesCount = 15;
+  uint64_t writingAddress = 0;
+  uint64_t readingAddresses[6] = {0};
+  uint8_t pipesOpen = 0;       // Bit per pipe
+  fifoEntry rxFifo[3];
+  uint8_t rxCount = 0;
+  fifoEntry ackFifo[3];
+  uint8_t ackCount = 0;
+  uint8_t pid = 0;
+  uint8_t arc = 0;
+  uint8_t lastPid[6];          // Last package per pipe, a retransmit of it is acknowledged but not received again
+  uint32_t lastCrc[6];
+  bool rpd = false;
+  unsigned long spiNanos = 0;  // Time on the bus that is not a whole us yet
+};
@@ -0,0 +1,2 @@
+// Linux backend: the radio needs no SPI bus
+#pragma once
@@ -0,0 +1,23 @@
+// Linux backend of the Servo library. The pulse width of every pin can be read back with halServoMicros()
+#pragma once
+#include <Arduino.h>
+
+#define MIN_PULSE_WIDTH 544
+#define MAX_PULSE_WIDTH 2400
+#define DEFAULT_PULSE_WIDTH 1500
+
+class Servo
+{
+public:
+  uint8_t attach(int pin);
+  void detach();
+  void write(int value);
+  void writeMicroseconds(int value);
+  int read();
+  int readMicroseconds();
+  bool attached();
+
+private:
+  int pin = -1;
+  int pulse = DEFAULT_PULSE_WIDTH;
+};
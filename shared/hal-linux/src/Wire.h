@@ -0,0 +1,2 @@
+// Linux backend: the display needs no I2C bus
+#pragma once
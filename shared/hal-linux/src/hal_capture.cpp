@@ -0,0 +1,149 @@
+// Capture of the received frames, and the decoder of the capture format
+#include "hal_capture.h"
+#include "hal_linux.h"
+#include <mutex>
+
+static std::mutex captureLock;          // The air between processes delivers frames from its own thread
+static FILE *captureFile = NULL;
+static bool captureChecked = false;     // HAL_CAPTURE has been looked at
+static unsigned long long captureLast = 0; // halClockMicros() of the last record
+
+// Opens the file of HAL_CAPTURE on the first frame. After a watchdog reset the capture goes on in a new session
+static FILE *openCapture()
+{
+  if (captureChecked)
+    return captureFile;
+  captureChecked = true;
+  const char *path = getenv("HAL_CAPTURE");
+  if (path == NULL || path[0] == 0)
+    return NULL;
+  const char *cause = getenv("HAL_RESET");
+  bool append = cause && strcmp(cause, "watchdog") == 0;
+  captureFile = fopen(path, append ? "ab" : "wb");
+  if (captureFile == NULL)
+  {
+    fprintf(stderr, "Can't write the capture %s\n", path);
+    return NULL;
+  }
+  if (ftell(captureFile) == 0)
+  {
+    uint8_t header[halCaptureHeaderSize];
+    halCaptureHeader(header);
+    fwrite(header, 1, sizeof(header), captureFile);
+  }
+  else
+    fputc(halCaptureSession, captureFile);
+  return captureFile;
+}
+
+void halCaptureFrame(const halFrame &frame, uint8_t pipe, uint8_t length, const uint8_t *payload, bool ack)
+{
+  std::lock_guard<std::mutex> guard(captureLock);
+  FILE *file = openCapture();
+  if (file == NULL)
+    return;
+  halCaptureRecord record;
+  record.time = halClockMicros();
+  record.channel = frame.channel;
+  record.pipe = pipe;
+  record.dataRate = frame.dataRate;
+  record.noAck = frame.noAck;
+  record.ack = ack;
+  record.length = min(length, (uint8_t)32);
+  memcpy(record.payload, payload, record.length);
+  uint8_t buffer[halCaptureMaxRecord];
+  size_t size = halCaptureEncode(record, captureLast, buffer);
+  captureLast = max(record.time, captureLast);
+  fwrite(buffer, 1, size, file);
+  fflush(file); // Nothing is lost when the process ends without exit(), like at a watchdog reset
+}
+
+void halCaptureHeader(uint8_t *buffer)
+{
+  memcpy(buffer, "RCAP", 4);
+  buffer[4] = halCaptureVersion;
+}
+
+size_t halCaptureEncode(const halCaptureRecord &record, unsigned long long previous, uint8_t *buffer)
+{
+  size_t size = 0;
+  buffer[size++] = (record.channel & 0x7F) | (record.ack ? 0x80 : 0);
+  unsigned long long delta = record.time > previous ? record.time - previous : 0;
+  do
+  {
+    buffer[size++] = (delta & 0x7F) | (delta > 0x7F ? 0x80 : 0);
+    delta >>= 7;
+  } while (delta > 0);
+  buffer[size++] = (record.pipe & 7) | (record.dataRate & 3) << 3 | (record.noAck ? 0x20 : 0);
+  uint8_t length = min(record.length, (uint8_t)32);
+  buffer[size++] = length;
+  memcpy(buffer + size, record.payload, length);
+  return size + length;
+}
+
+halCaptureReader::halCaptureReader(const uint8_t *data, size_t size) : data(data), size(size)
+{
+}
+
+bool halCaptureReader::valid()
+{
+  return size >= halCaptureHeaderSize && memcmp(data, "RCAP", 4) == 0 && data[4] == halCaptureVersion;
+}
+
+bool halCaptureReader::broken()
+{
+  return position < size;
+}
+
+bool halCaptureReader::readTime(unsigned long long *value)
+{
+  *value = 0;
+  for (uint8_t shift = 0; shift < 70; shift += 7)
+  {
+    if (position >= size)
+      return false;
+    uint8_t part = data[position++];
+    *value |= (unsigned long long)(part & 0x7F) << shift;
+    if ((part & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+bool halCaptureReader::next(halCaptureRecord *record)
+{
+  if (!valid())
+    return false;
+  if (sessions == 0)
+    sessions = 1;
+  while (position < size && data[position] == halCaptureSession)
+  {
+    position++;
+    sessions++;
+    sessionStart = last;
+    lastInSession = 0;
+  }
+  if (position >= size)
+    return false;
+  size_t start = position;
+  uint8_t info = data[position++];
+  unsigned long long delta;
+  if (!readTime(&delta) || position + 2 > size || data[position + 1] > 32 || position + 2 + data[position + 1] > size)
+  {
+    position = start; // Cut off, broken() tells
+    return false;
+  }
+  uint8_t flags = data[position++];
+  record->length = data[position++];
+  record->channel = info & 0x7F;
+  record->ack = info & 0x80;
+  record->pipe = flags & 7;
+  record->dataRate = flags >> 3 & 3;
+  record->noAck = flags & 0x20;
+  memcpy(record->payload, data + position, record->length);
+  position += record->length;
+  lastInSession += delta;
+  last = sessionStart + lastInSession;
+  record->time = last;
+  return true;
+}
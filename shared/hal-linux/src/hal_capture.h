@@ -0,0 +1,59 @@
+/*  Capture of the frames the radios receive. When HAL_CAPTURE names a file, every radio of the process records the frames it takes into its
+    RX FIFO there: the packages of the other side and the payloads that come back with the acknowledgements. A retransmit the radio drops is
+    not recorded. A process that the watchdog starts again appends to the capture, every other start begins a new one.
+
+    File format, all numbers LSB first:
+      header   "RCAP", version (1 byte)
+      record   info (1 byte): bits 0...6 = channel, bit 7 = ack payload
+               time (1...10 bytes): us since the previous record of the session, 7 bits per byte, bit 7 set = more bytes follow
+               flags (1 byte): bits 0...2 = pipe, bits 3...4 = rf24_datarate_e, bit 5 = no acknowledgement asked for
+               length (1 byte): 0...32
+               payload (length bytes)
+      session  info 0x7F, nothing else: the program started again and its clock from 0. The times of the next session continue after the
+               last record of the previous one
+    A package of the remote at 100 Hz takes 35 bytes, an hour of driving about 12 MB.
+*/
+
+#pragma once
+#include <RF24.h>
+#include <stddef.h>
+
+struct halCaptureRecord // One received frame
+{
+  unsigned long long time; // us since the start of the capture
+  uint8_t channel;         // 0...125
+  uint8_t pipe;            // 0...5
+  uint8_t dataRate;        // rf24_datarate_e
+  bool noAck;              // The sender didn't ask for an acknowledgement
+  bool ack;                // Payload of an acknowledgement, received by the sending radio
+  uint8_t length;          // 0...32
+  uint8_t payload[32];
+};
+
+const uint8_t halCaptureVersion = 1;
+const uint8_t halCaptureHeaderSize = 5;
+const uint8_t halCaptureSession = 0x7F; // info byte of a session mark
+const uint8_t halCaptureMaxRecord = 1 + 10 + 2 + 32;
+
+void halCaptureFrame(const halFrame &frame, uint8_t pipe, uint8_t length, const uint8_t *payload, bool ack); // Records a frame when HAL_CAPTURE is set
+size_t halCaptureEncode(const halCaptureRecord &record, unsigned long long previous, uint8_t *buffer); // Record after the one at previous us, returns its bytes
+void halCaptureHeader(uint8_t *buffer);                                                               // halCaptureHeaderSize bytes
+
+class halCaptureReader // Decodes a capture in memory
+{
+public:
+  halCaptureReader(const uint8_t *data, size_t size);
+  bool valid();                           // The header is right
+  bool next(halCaptureRecord *record);    // false at the end, or at a record that is cut off or broken
+  bool broken();                          // Reading stopped before the end of the data
+  unsigned int sessions = 0;              // Sessions read so far, 1 with the first record
+
+private:
+  bool readTime(unsigned long long *value);
+  const uint8_t *data;
+  size_t size;
+  size_t position = halCaptureHeaderSize;
+  unsigned long long sessionStart = 0;    // us of the capture the clock of the current session starts at
+  unsigned long long last = 0;            // us of the capture of the last record
+  unsigned long long lastInSession = 0;   // us of the session of the last record
+};
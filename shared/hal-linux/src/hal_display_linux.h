@@ -0,0 +1,105 @@
+/*  Linux backend of the display: an SH1106 emulated in memory. U8g2 renders like on the remote and sends the same I2C bytes,
+    the emulation keeps the 132x64 display RAM they write. halScreen() reads it back, halWriteScreen() prints it to a terminal.
+    On the virtual clock the bytes take the time they take on the I2C bus.
+*/
+
+#pragma once
+#include <U8g2lib.h>
+#include "hal_linux.h"
+
+struct halSh1106 // Display RAM and bus state of the emulated SH1106
+{
+  uint8_t ram[8][132]; // 8 pages of 8 rows, bit 0 = top row
+  uint8_t page = 0;
+  uint8_t column = 0;
+  bool dataTransfer = false;  // The control byte of this I2C transfer was 0x40
+  bool firstByte = false;     // Next byte is the control byte
+  unsigned long busBytes = 0; // Bytes sent on the I2C bus, without the address
+  unsigned long busNanos = 0; // Time on the bus that is not a whole us yet
+};
+
+inline halSh1106 &halScreen()
+{
+  static halSh1106 screen;
+  return screen;
+}
+
+// Byte procedure of U8g2: interprets the I2C transfers like the SH1106 does
+inline uint8_t halSh1106Bytes(u8x8_t *u8x8, uint8_t msg, uint8_t length, void *data)
+{
+  halSh1106 &screen = halScreen();
+  const uint8_t *bytes = (const uint8_t *)data;
+  switch (msg)
+  {
+  case U8X8_MSG_BYTE_START_TRANSFER:
+    screen.firstByte = true;
+    break;
+  case U8X8_MSG_BYTE_SEND:
+  {
+    uint32_t clock = u8x8->bus_clock > 0 ? u8x8->bus_clock : 100000;
+    screen.busNanos += length * (9000000000ULL / clock); // 9 bits per byte on the bus
+    halAdvanceClock(screen.busNanos / 1000);
+    screen.busNanos %= 1000;
+    screen.busBytes += length;
+    for (uint8_t i = 0; i < length; i++)
+    {
+      uint8_t value = bytes[i];
+      if (screen.firstByte)
+      {
+        screen.dataTransfer = (value & 0x40) != 0;
+        screen.firstByte = false;
+      }
+      else if (screen.dataTransfer)
+      {
+        if (screen.page < 8 && screen.column < 132)
+          screen.ram[screen.page][screen.column] = value;
+        screen.column++;
+      }
+      else if (value >= 0xB0 && value <= 0xB7) // Page address
+        screen.page = value - 0xB0;
+      else if (value <= 0x0F) // Lower nibble of the column address
+        screen.column = (screen.column & 0xF0) | value;
+      else if (value >= 0x10 && value <= 0x1F) // Upper nibble of the column address
+        screen.column = (screen.column & 0x0F) | (value - 0x10) << 4;
+    }
+    break;
+  }
+  default:
+    break;
+  }
+  return 1;
+}
+
+inline uint8_t halNoPins(u8x8_t *u8x8, uint8_t msg, uint8_t value, void *data)
+{
+  return 1;
+}
+
+// Pixel of the visible 128x64 area, the SH1106 shows columns 2...129 of its RAM
+inline bool halPixel(int x, int y)
+{
+  return halScreen().ram[y / 8][x + 2] >> (y % 8) & 1;
+}
+
+// Prints the screen with two rows per character line
+inline void halWriteScreen(FILE *file)
+{
+  for (int y = 0; y < 64; y += 2)
+  {
+    for (int x = 0; x < 128; x++)
+    {
+      static const char *const blocks[] = {" ", "▀", "▄", "█"};
+      fputs(blocks[halPixel(x, y) | halPixel(x, y + 1) << 1], file);
+    }
+    fputc('\n', file);
+  }
+}
+
+class halDisplay : public U8G2 // Same constructor as U8G2_SH1106_128X64_NONAME_1_HW_I2C
+{
+public:
+  halDisplay(const u8g2_cb_t *rotation, uint8_t reset = U8X8_PIN_NONE, uint8_t clock = U8X8_PIN_NONE, uint8_t data = U8X8_PIN_NONE) : U8G2()
+  {
+    u8g2_Setup_sh1106_i2c_128x64_noname_1(&u8g2, rotation, halSh1106Bytes, halNoPins);
+  }
+};
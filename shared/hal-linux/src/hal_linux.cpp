@@ -0,0 +1,474 @@
+// Linux backend of the Arduino API and the HAL: clock, pins, serial monitor, servos, EEPROM, reset cause and watchdog
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Servo.h>
+#include <hal.h>
+#include "hal_linux.h"
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <atomic>
+
+struct halBoard // Everything of one emulated microcontroller that a program can change
+{
+  unsigned long long micros = 0;                // Virtual clock
+  uint8_t pinModes[halPinCount] = {};
+  int pinLevels[halPinCount] = {};              // Driven by the program on outputs, by halSetDigital() on inputs
+  int analogValues[halPinCount];                // Set by halSetAnalog()
+  bool inputsSet[halPinCount] = {};             // The input level came from halSetDigital()
+  unsigned int toneFrequencies[halPinCount] = {};
+  unsigned long toneEnds[halPinCount] = {};     // millis() the tone stops, 0 = until noTone()
+  int servoPulses[halPinCount] = {};
+  unsigned long long servoChanges[halPinCount] = {}; // us on the clock of the board the pulse width last changed
+  unsigned long randomState = 1;
+  uint8_t eeprom[E2END + 1];
+  bool eepromLoaded = false;                    // The EEPROM file of the process board has been read
+  bool console = false;                         // Serial reads stdin, only the process board does
+  std::atomic<unsigned long> lastKick{0};       // millis() of the last kick of the watchdog
+  bool watchdogStarted = false;
+  uint8_t adcPin = A0;
+
+  halBoard()
+  {
+    for (int &value : analogValues) // Every analog input starts centered
+      value = 512;
+    memset(eeprom, 0xFF, sizeof(eeprom)); // Erased, like a new microcontroller
+  }
+};
+
+static halBoard processBoard; // Board of the program when it runs on its own
+static halBoard *board = &processBoard;
+
+halBoard *halNewBoard()
+{
+  halBoard *created = new halBoard;
+  created->eepromLoaded = true; // Only the process board keeps its EEPROM in the HAL_EEPROM file
+  return created;
+}
+
+void halSelectBoard(halBoard *selected)
+{
+  board = selected ? selected : &processBoard;
+}
+
+// Clock
+static struct timespec startTime = {0, 0}; // Start of the process, millis() and micros() count from here
+static bool virtualClock = false;          // Time only moves with halAdvanceClock() and delay()
+static void (*yieldHook)() = NULL;         // Set by a simulation that runs several programs, called whenever virtual time passes
+
+static unsigned long long elapsedMicros()
+{
+  if (virtualClock)
+    return board->micros;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (startTime.tv_sec == 0 && startTime.tv_nsec == 0)
+    startTime = now;
+  return (now.tv_sec - startTime.tv_sec) * 1000000ULL + (now.tv_nsec - startTime.tv_nsec) / 1000;
+}
+
+void halUseVirtualClock(unsigned long long startMicros)
+{
+  virtualClock = true;
+  board->micros = startMicros;
+}
+
+bool halVirtualClock()
+{
+  return virtualClock;
+}
+
+void halAdvanceClock(unsigned long long us)
+{
+  if (!virtualClock)
+    return;
+  board->micros += us;
+  if (yieldHook)
+    yieldHook();
+}
+
+unsigned long long halClockMicros()
+{
+  return elapsedMicros();
+}
+
+void halSetYield(void (*yield)())
+{
+  yieldHook = yield;
+}
+
+// On the virtual clock reading the clock takes a little time, so a program that waits for it in a loop gets there
+const unsigned int clockReadMicros = 2;
+
+unsigned long millis()
+{
+  halAdvanceClock(clockReadMicros);
+  return (unsigned long)(elapsedMicros() / 1000);
+}
+
+unsigned long micros()
+{
+  halAdvanceClock(clockReadMicros);
+  return (unsigned long)elapsedMicros();
+}
+
+void delay(unsigned long ms)
+{
+  if (virtualClock)
+    halAdvanceClock(ms * 1000ULL);
+  else
+    usleep(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  if (virtualClock)
+    halAdvanceClock(us);
+  else
+    usleep(us);
+}
+
+void yield()
+{
+}
+
+// Pins
+static bool validPin(uint8_t pin)
+{
+  return pin < halPinCount;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  if (!validPin(pin))
+    return;
+  board->pinModes[pin] = mode;
+  if (mode == INPUT_PULLUP && !board->inputsSet[pin])
+    board->pinLevels[pin] = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  if (validPin(pin))
+    board->pinLevels[pin] = value ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin)
+{
+  return validPin(pin) ? board->pinLevels[pin] : LOW;
+}
+
+int analogRead(uint8_t pin)
+{
+  return validPin(pin) ? board->analogValues[pin] : 0;
+}
+
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration)
+{
+  if (!validPin(pin))
+    return;
+  board->toneFrequencies[pin] = frequency;
+  board->toneEnds[pin] = duration > 0 ? max(millis() + duration, 1UL) : 0;
+}
+
+void noTone(uint8_t pin)
+{
+  if (validPin(pin))
+    board->toneFrequencies[pin] = 0;
+}
+
+void halSetAnalog(uint8_t pin, int value)
+{
+  if (validPin(pin))
+    board->analogValues[pin] = constrain(value, 0, 1023);
+}
+
+void halSetDigital(uint8_t pin, int value)
+{
+  if (!validPin(pin))
+    return;
+  board->pinLevels[pin] = value ? HIGH : LOW;
+  board->inputsSet[pin] = true;
+}
+
+int halDigitalOutput(uint8_t pin)
+{
+  return validPin(pin) && board->pinModes[pin] == OUTPUT ? board->pinLevels[pin] : LOW;
+}
+
+unsigned int halToneFrequency(uint8_t pin)
+{
+  if (!validPin(pin))
+    return 0;
+  if (board->toneEnds[pin] != 0 && (long)(elapsedMicros() / 1000 - board->toneEnds[pin]) >= 0)
+    board->toneFrequencies[pin] = 0;
+  return board->toneFrequencies[pin];
+}
+
+// Math
+long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+long random(long howBig)
+{
+  if (howBig <= 0)
+    return 0;
+  board->randomState = board->randomState * 1103515245UL + 12345UL; // Same generator on every run, like a microcontroller
+  return (long)((board->randomState >> 16) % (unsigned long)howBig);
+}
+
+long random(long howSmall, long howBig)
+{
+  if (howSmall >= howBig)
+    return howSmall;
+  return howSmall + random(howBig - howSmall);
+}
+
+void randomSeed(unsigned long seed)
+{
+  if (seed != 0)
+    board->randomState = seed;
+}
+
+// Serial monitor
+HardwareSerial Serial;
+
+void HardwareSerial::begin(unsigned long baud)
+{
+  processBoard.console = true;
+  fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+}
+
+static int peeked = -1; // Character read by available() that read() hands out
+
+int HardwareSerial::available()
+{
+  if (peeked < 0 && board->console)
+  {
+    unsigned char c;
+    if (::read(STDIN_FILENO, &c, 1) == 1)
+      peeked = c;
+  }
+  return peeked >= 0 ? 1 : 0;
+}
+
+int HardwareSerial::read()
+{
+  if (!available())
+    return -1;
+  int c = peeked;
+  peeked = -1;
+  return c;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  return fwrite(&c, 1, 1, stdout);
+}
+
+// Servos
+static void setPulse(uint8_t pin, int pulse)
+{
+  if (board->servoPulses[pin] == pulse)
+    return;
+  board->servoPulses[pin] = pulse;
+  board->servoChanges[pin] = elapsedMicros();
+}
+
+uint8_t Servo::attach(int newPin)
+{
+  if (!validPin(newPin))
+    return 0;
+  pin = newPin;
+  setPulse(pin, pulse);
+  return 1;
+}
+
+void Servo::detach()
+{
+  if (pin >= 0)
+    setPulse(pin, 0);
+  pin = -1;
+}
+
+void Servo::write(int value)
+{
+  if (value < MIN_PULSE_WIDTH) // Degrees, like the Servo library
+    value = map(constrain(value, 0, 180), 0, 180, MIN_PULSE_WIDTH, MAX_PULSE_WIDTH);
+  writeMicroseconds(value);
+}
+
+void Servo::writeMicroseconds(int value)
+{
+  pulse = constrain(value, MIN_PULSE_WIDTH, MAX_PULSE_WIDTH);
+  if (pin >= 0)
+    setPulse(pin, pulse);
+}
+
+int Servo::read()
+{
+  return map(pulse + 1, MIN_PULSE_WIDTH, MAX_PULSE_WIDTH, 0, 180);
+}
+
+int Servo::readMicroseconds()
+{
+  return pulse;
+}
+
+bool Servo::attached()
+{
+  return pin >= 0;
+}
+
+int halServoMicros(uint8_t pin)
+{
+  return validPin(pin) ? board->servoPulses[pin] : 0;
+}
+
+unsigned long long halServoChanged(uint8_t pin)
+{
+  return validPin(pin) ? board->servoChanges[pin] : 0;
+}
+
+// EEPROM
+EEPROMClass EEPROM;
+
+static void loadEeprom()
+{
+  if (board->eepromLoaded)
+    return;
+  board->eepromLoaded = true;
+  const char *path = getenv("HAL_EEPROM");
+  FILE *file = path ? fopen(path, "rb") : NULL;
+  if (file)
+  {
+    size_t length = fread(board->eeprom, 1, sizeof(board->eeprom), file);
+    (void)length;
+    fclose(file);
+  }
+}
+
+uint8_t EEPROMClass::read(int address)
+{
+  loadEeprom();
+  return address >= 0 && address <= E2END ? board->eeprom[address] : 0xFF;
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+  loadEeprom();
+  if (address < 0 || address > E2END)
+    return;
+  board->eeprom[address] = value;
+  const char *path = getenv("HAL_EEPROM");
+  FILE *file = path && board == &processBoard ? fopen(path, "wb") : NULL;
+  if (file)
+  {
+    fwrite(board->eeprom, 1, sizeof(board->eeprom), file);
+    fclose(file);
+  }
+}
+
+void EEPROMClass::update(int address, uint8_t value)
+{
+  if (read(address) != value)
+    write(address, value);
+}
+
+uint8_t *halEepromData()
+{
+  loadEeprom();
+  return board->eeprom;
+}
+
+// Reset cause, a watchdog reset starts the process again with HAL_RESET=watchdog
+byte halResetFlags()
+{
+  const char *cause = getenv("HAL_RESET");
+  if (cause && strcmp(cause, "watchdog") == 0)
+    return halResetWatchdog;
+  return halResetPowerOn;
+}
+
+// Watchdog, a thread that starts the process again when the program stops kicking it
+static std::atomic<bool> watchdogRunning(false); // The thread runs
+static char **arguments = NULL; // Of main(), to start the process again
+
+static void *watchdogThread(void *)
+{
+  while (true)
+  {
+    usleep(10000);
+    if (millis() - processBoard.lastKick.load() <= 500)
+      continue;
+    fprintf(stderr, "Watchdog reset\n");
+    fflush(stdout);
+    if (arguments == NULL)
+      abort();
+    setenv("HAL_RESET", "watchdog", 1);
+    execv("/proc/self/exe", arguments);
+    abort();
+  }
+  return NULL;
+}
+
+// On the virtual clock there is no thread, the simulation asks halWatchdogExpired() instead
+void halWatchdogStart()
+{
+  board->lastKick = millis();
+  board->watchdogStarted = true;
+  if (virtualClock || watchdogRunning.exchange(true))
+    return;
+  pthread_t thread;
+  pthread_create(&thread, NULL, watchdogThread, NULL);
+  pthread_detach(thread);
+}
+
+void halWatchdogKick()
+{
+  board->lastKick = millis();
+}
+
+bool halWatchdogExpired()
+{
+  return virtualClock && board->watchdogStarted && elapsedMicros() / 1000 - board->lastKick.load() > 500;
+}
+
+// ADC, the emulated conversion is finished right away
+void halAdcStart(byte pin)
+{
+  board->adcPin = pin;
+}
+
+bool halAdcDone()
+{
+  return true;
+}
+
+int halAdcValue()
+{
+  return analogRead(board->adcPin);
+}
+
+// The emulated EEPROM writes right away
+bool halEepromReady()
+{
+  return true;
+}
+
+// Runs the program like the Arduino core does. Tools that drive the program themselves build with HAL_NO_MAIN, the test runner of PlatformIO
+// brings its own main()
+#if !defined(HAL_NO_MAIN) && !defined(PIO_UNIT_TESTING)
+int main(int argc, char **argv)
+{
+  (void)argc;
+  arguments = argv;
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  setup();
+  while (true)
+    loop();
+}
+#endif
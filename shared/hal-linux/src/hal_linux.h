@@ -0,0 +1,24 @@
+// Access to the emulated hardware of the Linux backend, for the tools and tests that drive the programs
+#pragma once
+#include <Arduino.h>
+
+void halSetAnalog(uint8_t pin, int value);   // 0...1023, value of an analog input. All inputs start at 512, sticks centered
+void halSetDigital(uint8_t pin, int value);  // Level of an input pin. Inputs with pull-up start HIGH, buttons released
+int halDigitalOutput(uint8_t pin);           // Level the program drives on an output pin
+int halServoMicros(uint8_t pin);             // us, pulse width on a servo pin, 0 when no servo is attached
+unsigned long long halServoChanged(uint8_t pin); // halClockMicros() when the pulse width on a servo pin last changed
+unsigned int halToneFrequency(uint8_t pin);  // Hz, tone on a pin, 0 when silent
+uint8_t *halEepromData();                    // Contents of the EEPROM, E2END + 1 bytes
+
+// Clock. The virtual clock only moves with halAdvanceClock(), delay(), reading the clock and the air time of simulated radio frames
+void halUseVirtualClock(unsigned long long startMicros = 0);
+bool halVirtualClock();
+void halAdvanceClock(unsigned long long us); // Does nothing on the real clock
+void halSetYield(void (*yield)());           // Called whenever virtual time passes, a simulation continues another program there
+unsigned long long halClockMicros();         // us since the start, doesn't wrap like micros()
+bool halWatchdogExpired();                   // On the virtual clock: the program was started with a watchdog and stopped kicking it
+
+// Boards. A simulation that runs several programs in one process gives each its own pins, servos, tones, EEPROM, watchdog and virtual clock
+struct halBoard;
+halBoard *halNewBoard();               // Starts like a new microcontroller, with an erased EEPROM
+void halSelectBoard(halBoard *board); // The program that runs from now on, and the hal calls, use this board. nullptr = the board of the process
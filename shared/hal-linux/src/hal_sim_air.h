@@ -0,0 +1,57 @@
+/*  Simulated air for radios in the same process, for tests and simulations of the link. Everything that happens on it follows from the seed:
+    independent loss, burst loss after the Gilbert-Elliott model, interference per channel and bit errors, for the frames and the acknowledgements alike.
+    On the virtual clock every attempt takes its air time, the settling of the radio and the wait for the acknowledgement or the retransmit delay.
+*/
+
+#pragma once
+#include <RF24.h>
+#include <vector>
+
+struct halLinkModel // Behaviour of the simulated air
+{
+  uint32_t seed = 1;
+  float loss = 0;            // Chance that a frame is lost, independent of the other frames. The loss of the good state
+  float goodToBad = 0;       // Gilbert-Elliott: chance per frame to go from the good state to the bad state
+  float badToGood = 1;       // Chance per frame to go back to the good state, 1 / average length of a burst
+  float badLoss = 1;         // Chance that a frame is lost in the bad state
+  float noise[126] = {0};    // Chance per channel that interference destroys a frame, testRPD() sees it as often
+  float bitError = 0;        // Chance per bit of the payload that it flips
+  bool crc = true;           // The receiving radio drops frames with bit errors. Without CRC they arrive corrupted
+  unsigned int latency = 0;  // us added to every frame and acknowledgement on top of the air time
+};
+
+struct halLinkStats // What happened on the simulated air
+{
+  unsigned long frames = 0;     // Attempts sent, the retransmits included
+  unsigned long delivered = 0;  // Frames a radio received or acknowledged
+  unsigned long lost = 0;       // Lost by the independent loss
+  unsigned long burstLost = 0;  // Lost in the bad state of the Gilbert-Elliott model
+  unsigned long noiseLost = 0;  // Destroyed by interference on the channel
+  unsigned long crcDropped = 0; // Bit errors caught by the CRC
+  unsigned long corrupted = 0;  // Frames that arrived with bit errors
+  unsigned long acks = 0;       // Acknowledgements sent
+  unsigned long acksLost = 0;   // Acknowledgements that didn't make it back
+  unsigned long long airMicros = 0; // Time the air was busy
+};
+
+class halSimAir : public halAir
+{
+public:
+  halSimAir(const halLinkModel &model = halLinkModel());
+  void join(RF24 *radio) override;
+  void leave(RF24 *radio) override;
+  bool transmit(RF24 *sender, const halFrame &frame, halFrame *ack) override;
+  bool carrier(uint8_t channel) override;
+  void reset();                         // Starts again from the seed and clears the statistics
+  static unsigned int airTime(const halFrame &frame); // us a frame is on the air, with the settling of the radio
+  halLinkModel model;
+  halLinkStats stats;
+
+private:
+  bool survives(halFrame &frame);       // Applies the loss, noise and bit errors to a frame on its way, false = lost
+  float chance();                       // 0...1
+  void spend(unsigned long us);         // Moves the virtual clock and counts the busy air
+  std::vector<RF24 *> radios;
+  uint64_t state = 1;                   // Of the random generator
+  bool bad = false;                     // Gilbert-Elliott state
+};
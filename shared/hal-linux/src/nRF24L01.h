@@ -0,0 +1,2 @@
+// Linux backend: register names of the radio, the RF24 stand-in needs none
+#pragma once
@@ -0,0 +1,3 @@
+// Same as nRF24L01.h, for file systems that care about case
+#pragma once
+#include "nRF24L01.h"
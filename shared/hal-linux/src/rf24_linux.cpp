@@ -0,0 +1,588 @@
+// Linux backend of the RF24 library, and the air between processes
+#include <RF24.h>
+#include "hal_linux.h"
+#include "hal_capture.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+
+static uint64_t addressValue(const uint8_t *address)
+{
+  uint64_t value = 0;
+  for (int i = 4; i >= 0; i--) // LSB first, like the RF24 library
+    value = value << 8 | address[i];
+  return value;
+}
+
+static uint32_t payloadCrc(const halFrame &frame)
+{
+  uint32_t crc = 0xFFFFFFFF;
+  for (uint8_t i = 0; i < frame.length; i++)
+  {
+    crc ^= frame.payload[i];
+    for (byte bit = 0; bit < 8; bit++)
+      crc = crc >> 1 ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+static halAir *chosenAir = nullptr;
+
+void halSetAir(halAir *air)
+{
+  chosenAir = air;
+}
+
+RF24::RF24(uint16_t cePin, uint16_t csnPin, uint32_t spiSpeed) : spiSpeed(spiSpeed)
+{
+  memset(lastPid, 0xFF, sizeof(lastPid));
+  memset(lastCrc, 0, sizeof(lastCrc));
+}
+
+RF24::~RF24()
+{
+  if (air)
+    air->leave(this);
+}
+
+bool RF24::begin()
+{
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  if (air)
+    air->leave(this);
+  air = chosenAir ? chosenAir : halDefaultAir();
+  air->join(this);
+  return true;
+}
+
+void RF24::startListening()
+{
+  spi(2);
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  isListening = true;
+  rpd = false;
+}
+
+void RF24::stopListening()
+{
+  spi(1);
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  isListening = false;
+}
+
+bool RF24::listening()
+{
+  return isListening;
+}
+
+bool RF24::available()
+{
+  return available(nullptr);
+}
+
+bool RF24::available(uint8_t *pipe)
+{
+  spi(1);
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  if (rxCount == 0)
+    return false;
+  if (pipe)
+    *pipe = rxFifo[0].pipe;
+  return true;
+}
+
+void RF24::read(void *buffer, uint8_t length)
+{
+  spi(length);
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  if (rxCount == 0)
+    return;
+  memcpy(buffer, rxFifo[0].payload, min(length, (uint8_t)32));
+  rxCount--;
+  memmove(rxFifo, rxFifo + 1, rxCount * sizeof(fifoEntry));
+}
+
+bool RF24::write(const void *buffer, uint8_t length)
+{
+  return write(buffer, length, false);
+}
+
+bool RF24::write(const void *buffer, uint8_t length, bool multicast)
+{
+  spi(length);         // Payload into the TX FIFO
+  halAdvanceClock(10); // CE pulse that starts the transmission
+  halFrame frame;
+  {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if (air == nullptr)
+      return false;
+    memset(&frame, 0, sizeof(frame));
+    frame.address = writingAddress;
+    frame.channel = channel;
+    frame.dataRate = dataRate;
+    frame.paLevel = paLevel;
+    frame.pid = pid = (pid + 1) & 3;
+    frame.noAck = multicast || (autoAck & 1) == 0;
+    frame.length = dynamicPayloads ? min(length, (uint8_t)32) : payloadSize;
+    memcpy(frame.payload, buffer, min(length, frame.length));
+  }
+  for (uint8_t attempt = 0; attempt <= retriesCount; attempt++)
+  {
+    halFrame ack;
+    bool acknowledged = air->transmit(this, frame, &ack);
+    if (frame.noAck)
+    {
+      arc = 0;
+      return true;
+    }
+    if (acknowledged)
+    {
+      std::lock_guard<std::recursive_mutex> guard(lock);
+      arc = attempt;
+      if (ack.length > 0 && ackPayloads && rxCount < 3) // The ack payload arrives in pipe 0
+      {
+        fifoEntry &entry = rxFifo[rxCount++];
+        entry.pipe = 0;
+        entry.length = ack.length;
+        memcpy(entry.payload, ack.payload, sizeof(entry.payload));
+        halCaptureFrame(ack, 0, entry.length, entry.payload, true);
+      }
+      return true;
+    }
+  }
+  arc = retriesCount;
+  return false;
+}
+
+bool RF24::writeFast(const void *buffer, uint8_t length)
+{
+  return write(buffer, length, false);
+}
+
+bool RF24::writeFast(const void *buffer, uint8_t length, bool multicast)
+{
+  return write(buffer, length, multicast);
+}
+
+bool RF24::writeAckPayload(uint8_t pipe, const void *buffer, uint8_t length)
+{
+  spi(length);
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  if (ackCount >= 3 || pipe > 5)
+    return false;
+  fifoEntry &entry = ackFifo[ackCount++];
+  entry.pipe = pipe;
+  entry.length = min(length, (uint8_t)32);
+  memset(entry.payload, 0, sizeof(entry.payload));
+  memcpy(entry.payload, buffer, entry.length);
+  return true;
+}
+
+void RF24::openWritingPipe(const uint8_t *address)
+{
+  openWritingPipe(addressValue(address));
+}
+
+void RF24::openWritingPipe(uint64_t address)
+{
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  writingAddress = address & 0xFFFFFFFFFFULL;
+  readingAddresses[0] = writingAddress; // Pipe 0 receives the acknowledgements
+}
+
+void RF24::openReadingPipe(uint8_t pipe, const uint8_t *address)
+{
+  openReadingPipe(pipe, addressValue(address));
+}
+
+void RF24::openReadingPipe(uint8_t pipe, uint64_t address)
+{
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  if (pipe > 5)
+    return;
+  readingAddresses[pipe] = address & 0xFFFFFFFFFFULL;
+  pipesOpen |= 1 << pipe;
+}
+
+void RF24::closeReadingPipe(uint8_t pipe)
+{
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  pipesOpen &= ~(1 << pipe);
+}
+
+void RF24::setChannel(uint8_t newChannel)
+{
+  spi(1);
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  channel = min(newChannel, (uint8_t)125);
+  rpd = false;
+}
+
+uint8_t RF24::getChannel()
+{
+  return channel;
+}
+
+void RF24::setPALevel(uint8_t level, bool lnaEnable)
+{
+  spi(1);
+  paLevel = min(level, (uint8_t)RF24_PA_MAX);
+}
+
+uint8_t RF24::getPALevel()
+{
+  return paLevel;
+}
+
+bool RF24::setDataRate(rf24_datarate_e speed)
+{
+  spi(1);
+  dataRate = speed;
+  return true;
+}
+
+rf24_datarate_e RF24::getDataRate()
+{
+  return (rf24_datarate_e)dataRate;
+}
+
+void RF24::setAutoAck(bool enable)
+{
+  spi(1);
+  autoAck = enable ? 0x3F : 0;
+}
+
+void RF24::setAutoAck(uint8_t pipe, bool enable)
+{
+  if (pipe > 5)
+    return;
+  if (enable)
+    autoAck |= 1 << pipe;
+  else
+    autoAck &= ~(1 << pipe);
+}
+
+void RF24::enableAckPayload()
+{
+  ackPayloads = true;
+  dynamicPayloads = true; // Ack payloads need dynamic payloads, the RF24 library turns them on too
+}
+
+void RF24::enableDynamicPayloads()
+{
+  dynamicPayloads = true;
+}
+
+void RF24::disableDynamicPayloads()
+{
+  dynamicPayloads = false;
+  ackPayloads = false;
+}
+
+void RF24::setPayloadSize(uint8_t size)
+{
+  payloadSize = constrain(size, 1, 32);
+}
+
+uint8_t RF24::getDynamicPayloadSize()
+{
+  spi(1);
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  return rxCount > 0 ? rxFifo[0].length : 0;
+}
+
+void RF24::setRetries(uint8_t delay, uint8_t count)
+{
+  spi(1);
+  retriesDelay = min(delay, (uint8_t)15);
+  retriesCount = min(count, (uint8_t)15);
+}
+
+// Only takes time on the virtual clock. The RF24 library drives CSN around every command, that is left out
+void RF24::spi(uint8_t bytes)
+{
+  spiNanos += (bytes + 1) * 8 * (1000000000UL / spiSpeed);
+  halAdvanceClock(spiNanos / 1000);
+  spiNanos %= 1000;
+}
+
+uint8_t RF24::retryDelay()
+{
+  return retriesDelay;
+}
+
+uint8_t RF24::getARC()
+{
+  spi(1);
+  return arc;
+}
+
+bool RF24::testRPD()
+{
+  spi(1);
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  return rpd || (air && air->carrier(channel));
+}
+
+uint8_t RF24::flush_rx()
+{
+  spi(0);
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  rxCount = 0;
+  return 0;
+}
+
+uint8_t RF24::flush_tx()
+{
+  spi(0);
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  ackCount = 0;
+  return 0;
+}
+
+bool RF24::deliver(const halFrame &frame, halFrame *ack)
+{
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  if (!isListening || frame.channel != channel)
+    return false;
+  rpd = true; // Any signal on the channel, also for other addresses and data rates
+  if (frame.dataRate != dataRate)
+    return false;
+  uint8_t pipe = 0;
+  while (pipe < 6 && ((pipesOpen & 1 << pipe) == 0 || readingAddresses[pipe] != frame.address))
+    pipe++;
+  if (pipe == 6)
+    return false;
+  uint32_t crc = payloadCrc(frame);
+  bool retransmit = frame.pid == lastPid[pipe] && crc == lastCrc[pipe] && !frame.noAck;
+  if (!retransmit)
+  {
+    if (rxCount >= 3) // RX FIFO full, the package is neither received nor acknowledged
+      return false;
+    fifoEntry &entry = rxFifo[rxCount++];
+    entry.pipe = pipe;
+    entry.length = dynamicPayloads ? frame.length : payloadSize;
+    memcpy(entry.payload, frame.payload, sizeof(entry.payload));
+    lastPid[pipe] = frame.pid;
+    lastCrc[pipe] = crc;
+    halCaptureFrame(frame, pipe, entry.length, entry.payload, false);
+  }
+  if (frame.noAck || (autoAck & 1 << pipe) == 0)
+    return false;
+  memset(ack, 0, sizeof(halFrame));
+  ack->address = frame.address;
+  ack->channel = channel;
+  ack->dataRate = dataRate;
+  ack->paLevel = paLevel;
+  ack->pid = frame.pid;
+  ack->noAck = true;
+  for (uint8_t i = 0; i < ackCount && ackPayloads; i++) // The first ack payload waiting for this pipe goes along
+  {
+    if (ackFifo[i].pipe != pipe)
+      continue;
+    ack->length = ackFifo[i].length;
+    memcpy(ack->payload, ackFifo[i].payload, sizeof(ack->payload));
+    ackCount--;
+    memmove(ackFifo + i, ackFifo + i + 1, (ackCount - i) * sizeof(fifoEntry));
+    break;
+  }
+  return true;
+}
+
+// Air between processes: every process binds a datagram socket in the air directory and sends its frames to all sockets there.
+// A thread receives the frames of the other processes and acknowledges them right away, like the radio does on its own
+class processAir : public halAir
+{
+public:
+  void join(RF24 *radio) override;
+  void leave(RF24 *radio) override;
+  bool transmit(RF24 *sender, const halFrame &frame, halFrame *ack) override;
+  bool carrier(uint8_t channel) override;
+
+private:
+  struct datagram
+  {
+    uint32_t process; // pid of the sender
+    uint32_t number;  // Of the frame, the acknowledgement carries the same number
+    bool isAck;
+    halFrame frame;
+  };
+  void start();
+  void send(const datagram &message);
+  bool deliverLocal(RF24 *sender, const halFrame &frame, halFrame *ack);
+  static void *receiveThread(void *air);
+  std::mutex lock;
+  std::condition_variable ackArrived;
+  std::vector<RF24 *> radios;
+  int socketHandle = -1;
+  std::string directory;
+  uint32_t nextNumber = 0;
+  uint32_t waitingFor = 0; // Number of the frame that waits for an acknowledgement, 0 = none
+  bool ackReceived = false;
+  halFrame ackFrame;
+  unsigned long heard[126]; // micros() of the last frame per channel
+};
+
+void processAir::start()
+{
+  const char *path = getenv("HAL_AIR");
+  directory = path ? path : "/tmp/rc-car-air";
+  mkdir(directory.c_str(), 0777);
+  socketHandle = socket(AF_UNIX, SOCK_DGRAM, 0);
+  struct sockaddr_un name;
+  memset(&name, 0, sizeof(name));
+  name.sun_family = AF_UNIX;
+  snprintf(name.sun_path, sizeof(name.sun_path), "%s/%d", directory.c_str(), (int)getpid());
+  unlink(name.sun_path);
+  if (bind(socketHandle, (struct sockaddr *)&name, sizeof(name)) != 0)
+    fprintf(stderr, "Can't join the air in %s\n", directory.c_str());
+  memset(heard, 0, sizeof(heard));
+  pthread_t thread;
+  pthread_create(&thread, NULL, receiveThread, this);
+  pthread_detach(thread);
+}
+
+void processAir::join(RF24 *radio)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (socketHandle < 0)
+    start();
+  if (std::find(radios.begin(), radios.end(), radio) == radios.end())
+    radios.push_back(radio);
+}
+
+void processAir::leave(RF24 *radio)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  radios.erase(std::remove(radios.begin(), radios.end(), radio), radios.end());
+}
+
+// Sends a datagram to every other process on the air, the sockets of processes that ended are removed
+void processAir::send(const datagram &message)
+{
+  DIR *folder = opendir(directory.c_str());
+  if (folder == NULL)
+    return;
+  char own[16];
+  snprintf(own, sizeof(own), "%d", (int)getpid());
+  while (struct dirent *entry = readdir(folder))
+  {
+    if (entry->d_name[0] == '.' || strcmp(entry->d_name, own) == 0)
+      continue;
+    struct sockaddr_un name;
+    memset(&name, 0, sizeof(name));
+    name.sun_family = AF_UNIX;
+    if (snprintf(name.sun_path, sizeof(name.sun_path), "%s/%s", directory.c_str(), entry->d_name) >= (int)sizeof(name.sun_path))
+      continue;
+    if (sendto(socketHandle, &message, sizeof(message), MSG_DONTWAIT, (struct sockaddr *)&name, sizeof(name)) < 0 && errno == ECONNREFUSED)
+      unlink(name.sun_path);
+  }
+  closedir(folder);
+}
+
+bool processAir::deliverLocal(RF24 *sender, const halFrame &frame, halFrame *ack)
+{
+  std::vector<RF24 *> listeners;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    listeners = radios;
+  }
+  bool acknowledged = false;
+  for (RF24 *radio : listeners)
+  {
+    halFrame answer;
+    if (radio != sender && radio->deliver(frame, &answer) && !acknowledged)
+    {
+      *ack = answer;
+      acknowledged = true;
+    }
+  }
+  return acknowledged;
+}
+
+bool processAir::transmit(RF24 *sender, const halFrame &frame, halFrame *ack)
+{
+  if (frame.channel < 126)
+    heard[frame.channel] = micros();
+  if (deliverLocal(sender, frame, ack))
+    return true;
+  datagram message;
+  memset(&message, 0, sizeof(message));
+  message.process = getpid();
+  message.frame = frame;
+  std::unique_lock<std::mutex> guard(lock);
+  message.number = ++nextNumber;
+  if (message.number == 0)
+    message.number = ++nextNumber;
+  waitingFor = frame.noAck ? 0 : message.number;
+  ackReceived = false;
+  guard.unlock();
+  send(message);
+  if (frame.noAck)
+    return false;
+  guard.lock(); // Wait for the acknowledgement as long as the radio does before it retransmits
+  unsigned long timeout = (sender->retryDelay() + 1) * 250UL;
+  ackArrived.wait_for(guard, std::chrono::microseconds(timeout), [this] { return ackReceived; });
+  waitingFor = 0;
+  if (!ackReceived)
+    return false;
+  *ack = ackFrame;
+  return true;
+}
+
+bool processAir::carrier(uint8_t channel)
+{
+  return channel < 126 && heard[channel] != 0 && micros() - heard[channel] < 1000;
+}
+
+void *processAir::receiveThread(void *object)
+{
+  processAir *air = (processAir *)object;
+  datagram message;
+  while (true)
+  {
+    if (recv(air->socketHandle, &message, sizeof(message), 0) != sizeof(message))
+      continue;
+    if (message.frame.channel < 126)
+      air->heard[message.frame.channel] = micros();
+    if (message.isAck)
+    {
+      std::lock_guard<std::mutex> guard(air->lock);
+      if (message.number == air->waitingFor && !air->ackReceived)
+      {
+        air->ackFrame = message.frame;
+        air->ackReceived = true;
+        air->ackArrived.notify_all();
+      }
+      continue;
+    }
+    halFrame ack;
+    if (!air->deliverLocal(nullptr, message.frame, &ack))
+      continue;
+    datagram answer;
+    memset(&answer, 0, sizeof(answer));
+    answer.process = getpid();
+    answer.number = message.number;
+    answer.isAck = true;
+    answer.frame = ack;
+    struct sockaddr_un name;
+    memset(&name, 0, sizeof(name));
+    name.sun_family = AF_UNIX;
+    snprintf(name.sun_path, sizeof(name.sun_path), "%s/%u", air->directory.c_str(), message.process);
+    sendto(air->socketHandle, &answer, sizeof(answer), MSG_DONTWAIT, (struct sockaddr *)&name, sizeof(name));
+  }
+  return NULL;
+}
+
+halAir *halDefaultAir()
+{
+  static processAir *air = new processAir; // Never destroyed, its thread and the global radios outlive the static objects
+  return air;
+}
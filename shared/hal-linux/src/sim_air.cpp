@@ -0,0 +1,143 @@
+// Simulated air for radios in the same process
+#include "hal_sim_air.h"
+#include "hal_linux.h"
+#include <algorithm>
+
+halSimAir::halSimAir(const halLinkModel &model) : model(model)
+{
+  reset();
+}
+
+void halSimAir::reset()
+{
+  state = model.seed * 0x9E3779B97F4A7C15ULL + 1;
+  bad = false;
+  stats = halLinkStats();
+}
+
+void halSimAir::join(RF24 *radio)
+{
+  if (std::find(radios.begin(), radios.end(), radio) == radios.end())
+    radios.push_back(radio);
+}
+
+void halSimAir::leave(RF24 *radio)
+{
+  radios.erase(std::remove(radios.begin(), radios.end(), radio), radios.end());
+}
+
+// xorshift64*, the same sequence on every computer
+float halSimAir::chance()
+{
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return (float)((state * 0x2545F4914F6CDD1DULL) >> 40) / (float)(1 << 24);
+}
+
+unsigned int halSimAir::airTime(const halFrame &frame)
+{
+  unsigned int preamble = frame.dataRate == RF24_2MBPS ? 2 : 1;
+  unsigned int bits = (preamble + 5 + frame.length + 2) * 8 + 9; // Preamble, address, payload and CRC, packet control field
+  unsigned int us = frame.dataRate == RF24_2MBPS ? bits / 2 : frame.dataRate == RF24_250KBPS ? bits * 4 : bits;
+  return 130 + us; // The radio settles before it sends
+}
+
+void halSimAir::spend(unsigned long us)
+{
+  stats.airMicros += us;
+  halAdvanceClock(us);
+}
+
+bool halSimAir::survives(halFrame &frame)
+{
+  if (bad ? chance() < model.badToGood : chance() < model.goodToBad)
+    bad = !bad;
+  if (chance() < (bad ? model.badLoss : model.loss))
+  {
+    if (bad)
+      stats.burstLost++;
+    else
+      stats.lost++;
+    return false;
+  }
+  if (frame.channel < 126 && model.noise[frame.channel] > 0 && chance() < model.noise[frame.channel])
+  {
+    stats.noiseLost++;
+    return false;
+  }
+  if (model.bitError > 0)
+  {
+    bool flipped = false;
+    for (unsigned int bit = 0; bit < frame.length * 8u; bit++)
+    {
+      if (chance() < model.bitError)
+      {
+        frame.payload[bit / 8] ^= 1 << bit % 8;
+        flipped = true;
+      }
+    }
+    if (flipped)
+    {
+      if (model.crc && chance() * 65536 >= 1) // CRC16 misses one in 65536 corrupted frames
+      {
+        stats.crcDropped++;
+        return false;
+      }
+      stats.corrupted++;
+    }
+  }
+  return true;
+}
+
+bool halSimAir::transmit(RF24 *sender, const halFrame &frame, halFrame *ack)
+{
+  unsigned long retransmitDelay = (sender->retryDelay() + 1) * 250UL;
+  stats.frames++;
+  spend(airTime(frame) + model.latency);
+  halFrame received = frame;
+  if (!survives(received))
+  {
+    if (!frame.noAck)
+      spend(retransmitDelay);
+    return false;
+  }
+  bool acknowledged = false;
+  bool heard = false;
+  for (RF24 *radio : radios)
+  {
+    halFrame answer;
+    if (radio == sender || !radio->listening())
+      continue;
+    bool acked = radio->deliver(received, &answer);
+    heard = heard || acked || frame.noAck;
+    if (acked && !acknowledged)
+    {
+      *ack = answer;
+      acknowledged = true;
+    }
+  }
+  if (heard)
+    stats.delivered++;
+  if (frame.noAck)
+    return false;
+  if (!acknowledged)
+  {
+    spend(retransmitDelay);
+    return false;
+  }
+  stats.acks++;
+  spend(airTime(*ack) + model.latency);
+  if (!survives(*ack))
+  {
+    stats.acksLost++;
+    spend(retransmitDelay > airTime(*ack) ? retransmitDelay - airTime(*ack) : 0);
+    return false;
+  }
+  return true;
+}
+
+bool halSimAir::carrier(uint8_t channel)
+{
+  return channel < 126 && model.noise[channel] > 0 && chance() < model.noise[channel];
+}
@@ -0,0 +1,31 @@
+/*  Hardware abstraction layer of the RC car sender and receiver.
+    Clock, GPIO, servo pulses, radio, display and EEPROM go through the Arduino API and the RF24, Servo, U8g2 and EEPROM libraries,
+    those are the interfaces of the HAL. On the Pro Mini and the Teensy LC the backends are the Arduino cores and the libraries themselves,
+    on Linux the hal-linux library implements the same interfaces, so both programs run as ordinary processes.
+    What the Arduino API has no function for is declared here: the cause of the last reset, the watchdog, an ADC and an EEPROM that don't wait,
+    and RAM that survives a reset.
+*/
+
+#pragma once
+#include <Arduino.h>
+
+// Causes of the last reset, bits of halResetFlags()
+const byte halResetPowerOn = 1;
+const byte halResetExternal = 2;
+const byte halResetBrownout = 4;
+const byte halResetWatchdog = 8;
+
+byte halResetFlags();     // Cause of the last reset, captured before the variables are initialized
+void halWatchdogStart();  // Resets the microcontroller when the watchdog isn't kicked for 500 ms
+void halWatchdogKick();   // Restarts the watchdog period
+void halAdcStart(byte pin); // Starts a conversion of the analog input, doesn't wait for it
+bool halAdcDone();        // The conversion that was started last has finished
+int halAdcValue();        // 0...1023, result of the last finished conversion
+bool halEepromReady();    // The EEPROM takes a byte without waiting for the last write, that takes about 3.4 ms on the Pro Mini
+
+// Keeps a variable over a watchdog or brownout reset, it isn't initialized at startup. Only the Pro Mini keeps its RAM, elsewhere it starts at 0
+#ifdef __AVR__
+#define HAL_NOINIT __attribute__((section(".noinit")))
+#else
+#define HAL_NOINIT
+#endif
@@ -0,0 +1,76 @@
+// AVR backend of the HAL, for the Pro Mini
+#ifdef __AVR__
+
+#include "hal.h"
+#include <avr/wdt.h>
+#include <avr/eeprom.h>
+
+uint8_t resetCause __attribute__((section(".noinit"))); // MCUSR at startup, survives the initialization of the variables
+
+// Runs before the variables are initialized, so also before the libraries and setup(). Stops the watchdog that stays on after a watchdog reset.
+// Needs a bootloader that doesn't hang on a watchdog reset, like Optiboot. The ATmegaBOOT the Pro Mini ships with waits about a second
+// with the watchdog still on at 16 ms, and resets over and over (see the README)
+void captureReset() __attribute__((naked, used, section(".init3")));
+void captureReset()
+{
+  resetCause = MCUSR;
+  if (resetCause == 0) // Optiboot clears MCUSR and hands it over in r2
+  {
+    asm volatile("mov %0, r2" : "=r"(resetCause));
+    if (resetCause & ~(_BV(PORF) | _BV(EXTRF) | _BV(BORF) | _BV(WDRF))) // Another bootloader leaves anything in r2, then the cause stays unknown
+      resetCause = 0;
+  }
+  MCUSR = 0;
+  wdt_disable();
+}
+
+byte halResetFlags()
+{
+  byte flags = 0;
+  if (resetCause & _BV(PORF))
+    flags |= halResetPowerOn;
+  if (resetCause & _BV(EXTRF))
+    flags |= halResetExternal;
+  if (resetCause & _BV(BORF))
+    flags |= halResetBrownout;
+  if (resetCause & _BV(WDRF))
+    flags |= halResetWatchdog;
+  return flags;
+}
+
+void halWatchdogStart()
+{
+  wdt_enable(WDTO_500MS);
+}
+
+void halWatchdogKick()
+{
+  wdt_reset();
+}
+
+void halAdcStart(byte pin)
+{
+  ADMUX = _BV(REFS0) | ((pin - A0) & 0x07); // AVcc as reference
+#if F_CPU > 8000000L
+  ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0) | _BV(ADSC); // 125 kHz ADC clock at 16 MHz
+#else
+  ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADSC); // 125 kHz ADC clock at 8 MHz, about 100 us per conversion
+#endif
+}
+
+bool halAdcDone()
+{
+  return (ADCSRA & _BV(ADSC)) == 0;
+}
+
+int halAdcValue()
+{
+  return ADC;
+}
+
+bool halEepromReady()
+{
+  return eeprom_is_ready();
+}
+
+#endif
@@ -0,0 +1,9 @@
+// Display of the HAL: the 1.3 inch SH1106 OLED of the remote on I2C. Only included by the sender, it needs the U8g2 library
+#pragma once
+#include <U8g2lib.h>
+
+#ifdef HAL_LINUX
+#include <hal_display_linux.h> // SH1106 emulated in memory
+#else
+typedef U8G2_SH1106_128X64_NONAME_1_HW_I2C halDisplay; // 128x64 1.3 inch OLED, I2C, page buffer
+#endif
@@ -0,0 +1,53 @@
+// Teensy LC backend of the HAL, for the remote
+#if defined(__MKL26Z64__)
+
+#include "hal.h"
+
+byte halResetFlags()
+{
+  byte flags = 0;
+  if (RCM_SRS0 & RCM_SRS0_POR)
+    flags |= halResetPowerOn;
+  if (RCM_SRS0 & RCM_SRS0_PIN)
+    flags |= halResetExternal;
+  if (RCM_SRS0 & RCM_SRS0_LVD)
+    flags |= halResetBrownout;
+  if (RCM_SRS0 & RCM_SRS0_WDOG)
+    flags |= halResetWatchdog;
+  return flags;
+}
+
+// The COP watchdog of the KL26 can only be set up once after a reset, and the Teensy startup code turns it off
+void halWatchdogStart()
+{
+}
+
+void halWatchdogKick()
+{
+}
+
+byte adcPin = A0; // Input of the conversion that was started last
+
+// analogRead() of the Teensy LC takes about 10 us, short enough to do the conversion right away
+void halAdcStart(byte pin)
+{
+  adcPin = pin;
+}
+
+bool halAdcDone()
+{
+  return true;
+}
+
+int halAdcValue()
+{
+  return analogRead(adcPin);
+}
+
+// The EEPROM of the Teensy LC is emulated in flash, the library does its writes right away
+bool halEepromReady()
+{
+  return true;
+}
+
+#endif